@@ -0,0 +1,452 @@
+// Arduino XBee Library for GroveStreams Wireless Sensor Network.
+// Frame-processing benchmark.
+//
+// This work by Jack Christensen is licensed under CC BY-SA 4.0,
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// Feeds a scripted mix of API frames (TX status, AT command responses,
+// modem status, ZB RX data, time sync and message fragment packets) from a
+// simulated radio (gsXBeeSim) through gsXBee::read(), and reports frames/second,
+// the time per frame for each xbeeReadStatus_t, and the number of bytes read
+// from the radio, written to the radio, and copied into gsXBee's buffers per
+// frame. Received data packets are popped from the queue, as a sketch would.
+// No XBee is needed. Times include the library's own Serial logging,
+// so run it at the baud rate and GSXBEE_LOG_LEVEL used in production for
+// representative numbers.
+//
+// It then compares D packets (text) with B packets (binary, see setStreamDict())
+// carrying the same four-stream report: the time to build and send a report,
+// the bytes sent to the radio per report, and the time for read() to receive it.
+// The W row builds the same D packet in place with gsXBeeWriter instead of
+// batching it.
+//
+// It then reads the same mix of D packet, modem status and TX status frames
+// with a gsXBee, which uses the radio through the Stream interface, and with
+// a gsXBeeT bound to a serial port class without virtual functions, then
+// sends the same D packets with each, and reports the bytes/second each can
+// read from and write to the radio (with logging off).
+//
+// Finally it fuzzes the packet header and Node ID parsers: NFUZZ randomly
+// built and mutated packets and Node IDs are fed through read(), and it
+// reports the count of each parse result (see xbeeParseErr_t), the time per
+// frame, and the number of times a parsed field was out of bounds (should
+// be zero).
+//
+// Use the results as a baseline when evaluating changes to the library.
+
+#include <gsXBee.h>
+#include <gsXBeeSim.h>
+#include <Streaming.h>                      //http://arduiniana.org/libraries/streaming/
+#include <XBee.h>                           //http://github.com/andrewrapp/xbee-arduino
+
+const uint32_t BAUD_RATE(115200);
+const uint16_t NFRAMES(1000);               //frames to process per run
+const uint8_t TS_REQUEST_LEN(8);            //time sync request data: UTC and origin (a reply is 12 bytes)
+const uint8_t FRAG_LEN(10);                 //message fragment data: message ID, sequence, packet type, 7 bytes
+const uint8_t NSTATUS(N_READ_STATUS);
+
+const char* const statusNames[NSTATUS] =
+{
+    "NO_TRAFFIC", "READ_TIMEOUT", "TX_ACK", "TX_FAIL", "COMMAND_RESPONSE", "AI_CMD_RESPONSE", "DA_CMD_RESPONSE",
+    "FR_CMD_RESPONSE", "NI_CMD_RESPONSE", "VR_CMD_RESPONSE", "MODEM_STATUS", "RX_NO_ACK", "RX_DATA", "RX_TIMESYNC",
+    "RX_ERROR", "RX_UNKNOWN", "UNKNOWN_FRAME",
+    "DB_CMD_RESPONSE", "RX_FRAGMENT", "RX_MESSAGE", "ROUTE_RECORD", "MTO_REQUEST"
+};
+
+struct benchStat_t
+{
+    uint16_t frames;
+    uint32_t us;
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+    uint32_t bytesCopied;
+};
+
+uint8_t simBuf[512];
+gsXBeeSim sim(simBuf, sizeof(simBuf));
+gsXBee xb;
+benchStat_t stats[NSTATUS];
+bool done;
+
+const uint16_t NREPORTS(200);               //reports to encode and decode per packet type
+const char* const streamDict[] = { "temperature", "humidity", "pressure", "battery" };
+uint8_t codecBuf[128];
+gsXBeeSim codecSim(codecBuf, sizeof(codecBuf));
+gsXBee node;                                //sends the reports
+gsXBee coord;                               //receives them
+
+const uint16_t NFUZZ(2000);                 //packets and Node IDs to fuzz
+const uint8_t NPARSE(PARSE_NI_RANGE + 1);
+const char* const parseNames[NPARSE] =
+{
+    "PARSE_OK", "PARSE_TOO_SHORT", "PARSE_NO_SOH", "PARSE_NO_STX", "PARSE_COMPID_LEN", "PARSE_TOO_LONG",
+    "PARSE_NI_FORMAT", "PARSE_NI_RANGE"
+};
+uint8_t fuzzBuf[160];
+gsXBeeSim fuzzSim(fuzzBuf, sizeof(fuzzBuf));
+gsXBee fuzz;
+
+//bytes the library copied out of the XBee frame buffer into its own buffers
+//(payload and component ID for received packets, node ID for NI responses),
+//and from there into its queues: the receive queue for data packets, the
+//time sync queue for requests (we are a time server), and a message slot for
+//fragments, counted when the message is complete. call before pop().
+uint16_t bytesCopied(xbeeReadStatus_t s)
+{
+    uint16_t n = strlen(xb.sendingCompID) + 1;
+    rxPacket_t* pkt;
+    rxMessage_t* msg;
+    switch (s)
+    {
+    case RX_DATA:
+        pkt = xb.peek();
+        if (pkt != NULL) n += strlen(pkt->compID) + 1 + pkt->len + 1;
+        //fall through
+    case RX_UNKNOWN:
+        return n + strlen(xb.payload) + 1;
+    case RX_TIMESYNC:
+        return n + TS_REQUEST_LEN + strlen(xb.sendingCompID) + 1 + 4;      //request, then component ID and origin
+    case RX_FRAGMENT:
+        return n + FRAG_LEN;
+    case RX_MESSAGE:
+        msg = xb.getMessage();
+        return n + FRAG_LEN + (msg != NULL ? strlen(msg->compID) + 1 + msg->len + 1 : 0);
+    case NI_CMD_RESPONSE:
+        return strlen(xb.compID) + 1;                       //the component ID, parsed in place
+    default:
+        return 0;
+    }
+}
+
+//send and receive NREPORTS reports as D packets, or B packets if binary is true
+void codecBench(bool binary)
+{
+    node.setSerial(codecSim);
+    coord.setSerial(codecSim);
+    strcpy(node.compID, "node1");
+    node.setStreamDict(binary ? streamDict : NULL, 4);
+    coord.setStreamDict(binary ? streamDict : NULL, 4);
+    coord.rssPolicy = RSS_OFF;
+    node.txWindow = 0;                      //no TX statuses come back, send every report at once
+
+    uint32_t bytesOut = codecSim.bytesWritten;
+    uint32_t usEncode = 0;
+    uint8_t len = 0;
+    for (uint16_t i = 0; i < NREPORTS; ++i)
+    {
+        uint32_t usStart = micros();
+        node.batchAdd("temperature", 21.53 + i, 2);
+        node.batchAdd("humidity", 45 + (int)(i & 15));
+        node.batchAdd("pressure", 1013.2, 1);
+        node.batchAdd("battery", 3.31, 2);
+        len = node.batchLength();
+        node.batchFlush();
+        usEncode += micros() - usStart;
+    }
+    uint32_t sent = codecSim.bytesWritten - bytesOut;
+
+    //play the last report back to the coordinator
+    uint8_t* body = (uint8_t*)node.payload + 3 + strlen(node.compID);
+    codecSim.clear();
+    codecSim.packet(XBeeAddress64(0x0013A200, 0x40A1B2C3), binary ? 'B' : 'D', node.compID, body, len);
+    codecSim.repeat(true);
+    uint32_t usDecode = 0;
+    for (uint16_t i = 0; i < NREPORTS; ++i)
+    {
+        uint32_t usStart = micros();
+        coord.read();
+        usDecode += micros() - usStart;
+        coord.pop();
+    }
+    codecSim.repeat(false);
+    codecSim.clear();
+
+    Serial << (binary ? 'B' : 'D') << '\t' << len << '\t' << sent / NREPORTS << F("\t\t");
+    Serial << (float)usEncode / NREPORTS << F("\t\t") << (float)usDecode / NREPORTS << endl;
+}
+
+//send NREPORTS reports as D packets formatted in place by gsXBeeWriter
+void writerBench()
+{
+    uint32_t bytesOut = codecSim.bytesWritten;
+    uint32_t usEncode = 0;
+    uint8_t len = 0;
+    for (uint16_t i = 0; i < NREPORTS; ++i)
+    {
+        uint32_t usStart = micros();
+        gsXBeeWriter w(node);
+        w << F("&temperature=") << _FLOAT(21.53 + i, 2) << F("&humidity=") << 45 + (int)(i & 15);
+        w << F("&pressure=") << _FLOAT(1013.2, 1) << F("&battery=") << _FLOAT(3.31, 2);
+        len = w.length();
+        w.send();
+        usEncode += micros() - usStart;
+    }
+    uint32_t sent = codecSim.bytesWritten - bytesOut;
+    codecSim.clear();
+    Serial << 'W' << '\t' << len << '\t' << sent / NREPORTS << F("\t\t") << (float)usEncode / NREPORTS << F("\t\t-\n");
+}
+
+//a serial port without virtual functions, for gsXBeeT. plays back the
+//script in portSim's buffer continuously, and counts and discards the
+//bytes written to it.
+class ScriptPort
+{
+public:
+    ScriptPort(const uint8_t* buf) : bytesRead(0), bytesWritten(0), buf(buf), len(0), pos(0) {}
+    void setLength(uint16_t n) { len = n; pos = 0; }
+    int available()
+    {
+        if (pos >= len) pos = 0;
+        return len - pos;
+    }
+    int read()
+    {
+        ++bytesRead;
+        return buf[pos++];
+    }
+    size_t write(uint8_t)
+    {
+        ++bytesWritten;
+        return 1;
+    }
+    uint32_t bytesRead;
+    uint32_t bytesWritten;
+
+private:
+    const uint8_t* buf;
+    uint16_t len;
+    uint16_t pos;
+};
+
+const uint16_t NPORT(3000);                 //frames to read per port binding
+uint8_t portBuf[128];
+gsXBeeSim portSim(portBuf, sizeof(portBuf));
+ScriptPort port(portBuf);
+gsXBee viaStream;                           //reads portSim through Stream
+gsXBeeT<ScriptPort> viaPort;                //reads the same script through port
+
+//read NPORT frames with xbee, returns microseconds
+template <class T> uint32_t readFrames(T &xbee)
+{
+    uint32_t usStart = micros();
+    for (uint16_t n = 0; n < NPORT; )
+    {
+        if (xbee.read() != NO_TRAFFIC) ++n;
+        xbee.pop();
+    }
+    return micros() - usStart;
+}
+
+//send NPORT data packets with xbee, returns microseconds
+template <class T> uint32_t sendFrames(T &xbee)
+{
+    char data[] = "&t=21.5&h=45";
+    uint32_t usStart = micros();
+    for (uint16_t n = 0; n < NPORT; ++n) xbee.sendData(data);
+    return micros() - usStart;
+}
+
+//compare the read and write throughput of the Stream and template port bindings
+void portBench()
+{
+    portSim.clear();
+    portSim.packet(XBeeAddress64(0x0013A200, 0x40A1B2C3), 'D', "node1", "&t=21.5&h=45");
+    portSim.modemStatus(ASSOCIATED);
+    portSim.txStatus(0x55, 0);
+    portSim.repeat(true);
+    port.setLength(portSim.scriptLength());
+
+    viaStream.setSerial(portSim);
+    viaPort.setSerial(port);
+    viaStream.rssPolicy = viaPort.rssPolicy = RSS_OFF;
+    viaStream.txWindow = viaPort.txWindow = 0;              //no TX statuses come back
+    viaStream.setLog(NULL);
+    viaPort.setLog(NULL);
+
+    uint32_t bytes = portSim.bytesRead;
+    uint32_t us = readFrames(viaStream);
+    bytes = portSim.bytesRead - bytes;
+    Serial << F("\nPort\t\tBytes\tus\tBytes/s\n");
+    Serial << F("Stream read\t") << bytes << '\t' << us << '\t' << (us ? 1.0e6 * bytes / us : 0) << endl;
+    us = readFrames(viaPort);
+    Serial << F("gsXBeeT read\t") << port.bytesRead << '\t' << us << '\t' << (us ? 1.0e6 * port.bytesRead / us : 0) << endl;
+    bytes = portSim.bytesWritten;
+    us = sendFrames(viaStream);
+    bytes = portSim.bytesWritten - bytes;
+    Serial << F("Stream write\t") << bytes << '\t' << us << '\t' << (us ? 1.0e6 * bytes / us : 0) << endl;
+    us = sendFrames(viaPort);
+    Serial << F("gsXBeeT write\t") << port.bytesWritten << '\t' << us << '\t' << (us ? 1.0e6 * port.bytesWritten / us : 0) << endl;
+    portSim.repeat(false);
+    portSim.clear();
+}
+
+//returns a random character, biased toward the ones the parsers look for
+char fuzzChar()
+{
+    const char special[] = { SOH, STX, '_', '0', '9', 0 };
+    return random(4) == 0 ? special[random(sizeof(special))] : random(256);
+}
+
+//feed NFUZZ randomly built and mutated packets, then NFUZZ Node IDs, through
+//read(), counting the parse results and checking that the parsed fields
+//stay within bounds.
+void fuzzBench()
+{
+    uint16_t results[NPARSE];
+    memset(results, 0, sizeof(results));
+    uint16_t bad = 0;
+    uint32_t us = 0;
+    XBeeAddress64 addr(0x0013A200, 0x40A1B2C3);
+    fuzz.setSerial(fuzzSim);
+    fuzz.rssPolicy = RSS_OFF;
+    randomSeed(1);
+
+    for (uint16_t i = 0; i < NFUZZ; ++i)
+    {
+        //a packet that is usually nearly valid: SOH, type, component ID, STX, data
+        uint8_t d[99];
+        uint8_t len = 0;
+        d[len++] = SOH;
+        d[len++] = "DMHBFS"[random(6)];
+        uint8_t idLen = random(11);
+        while (idLen-- && len < sizeof(d)) d[len++] = 'a' + random(26);
+        if (len < sizeof(d)) d[len++] = STX;
+        uint8_t dataLen = random(sizeof(d) - len + 1);
+        while (dataLen--) d[len++] = random(256);
+        uint8_t nMutate = random(4);                        //then mutate it
+        while (nMutate-- && len > 0) d[random(len)] = fuzzChar();
+        if (random(8) == 0) len = random(len + 1);          //or truncate it
+
+        fuzzSim.clear();
+        fuzzSim.zbRX(addr, 0x1234, ZB_PACKET_ACKNOWLEDGED, d, len);
+        fuzz.parseErr = PARSE_OK;
+        uint32_t usStart = micros();
+        fuzz.read();
+        us += micros() - usStart;
+        fuzz.pop();
+        ++results[fuzz.parseErr];
+        if (memchr(fuzz.sendingCompID, 0, 9) == NULL || memchr(fuzz.payload, 0, PAYLOAD_LEN) == NULL) ++bad;
+    }
+
+    for (uint16_t i = 0; i < NFUZZ; ++i)
+    {
+        char ni[21];                                        //a Node ID, usually nearly valid
+        uint8_t len = 0;
+        uint8_t idLen = random(11);
+        while (idLen--) ni[len++] = 'a' + random(26);
+        ni[len++] = '_';
+        for (uint8_t j = 0; j < 8; ++j) ni[len++] = '0' + random(10);
+        uint8_t nMutate = random(3);
+        while (nMutate--) ni[random(len)] = fuzzChar();
+        if (random(8) == 0) len = random(len + 1);
+        ni[len] = 0;
+
+        uint8_t cmd[] = { 'N', 'I' };
+        uint8_t frameID = fuzz.sendCommand(cmd);
+        fuzzSim.clear();
+        fuzzSim.atResponse(frameID, "NI", AT_OK, (uint8_t*)ni, len);
+        fuzz.parseErr = PARSE_OK;
+        uint32_t usStart = micros();
+        fuzz.read();
+        us += micros() - usStart;
+        ++results[fuzz.parseErr];
+        if (strlen(fuzz.compID) > 8 || fuzz.txSec >= 60 || (fuzz.txInterval && fuzz.txOffset >= fuzz.txInterval)) ++bad;
+    }
+    fuzzSim.clear();
+
+    Serial << F("\nParse result\t\tCount\n");
+    for (uint8_t i = 0; i < NPARSE; ++i)
+    {
+        Serial << parseNames[i] << (strlen(parseNames[i]) < 16 ? F("\t\t") : F("\t")) << results[i] << endl;
+    }
+    Serial << F("Time\t\t\t") << 1000.0 * us / (2 * NFUZZ) << F(" ns/frame\n");
+    Serial << F("Out of bounds\t\t") << bad << endl;
+}
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+    Serial << F( "\n" __FILE__ " " __DATE__ " " __TIME__ "\n" );
+
+    XBeeAddress64 node1(0x0013A200, 0x40A1B2C3);
+    XBeeAddress64 node2(0x0013A200, 0x40A1B2C4);
+    uint8_t ai[] = { 0x00 };
+    uint8_t vr[] = { 0x23, 0xA7 };
+    uint8_t db[] = { 0x48 };
+    uint8_t tsReq[TS_REQUEST_LEN] = { 0x00, 0x00, 0x00, 0x56, 0x00, 0x00, 0x12, 0x34 };    //UTC and origin
+    uint8_t frag1[FRAG_LEN] = { 1, 0x00, 'D', '&', 'a', '=', '1', '2', '3', '4' };
+    uint8_t frag2[FRAG_LEN] = { 1, 0x81, 'D', '&', 'b', '=', '5', '6', '7', '8' };
+    uint8_t junk[] = { 'n', 'o', ' ', 'S', 'O', 'H' };
+
+    //a coordinator's typical traffic mix
+    sim.modemStatus(ASSOCIATED);
+    sim.atResponse(1, "AI", AT_OK, ai, sizeof(ai));
+    sim.atString(1, "NI", "bench_10010000");
+    sim.atResponse(1, "VR", AT_OK, vr, sizeof(vr));
+    sim.txStatus(1, SUCCESS);
+    sim.packet(node1, 'D', "node1", "&t=21.5&h=45&p=1013.2&v=3.31");
+    sim.atResponse(1, "DB", AT_OK, db, sizeof(db));         //answers the RSS query made for RX data
+    sim.txStatus(1, NETWORK_ACK_FAILURE, 0, 2);
+    sim.packet(node2, 'S', "node2", tsReq, sizeof(tsReq));
+    sim.packet(node1, 'F', "node1", frag1, sizeof(frag1));  //a two-fragment message
+    sim.packet(node1, 'F', "node1", frag2, sizeof(frag2));
+    sim.packet(node2, 'M', "node2", "&alarm=1");
+    sim.atResponse(1, "DB", AT_OK, db, sizeof(db));
+    sim.packet(node1, 'D', "node1", "&t=21.5", ZB_BROADCAST_PACKET);
+    sim.zbRX(node2, 0x5678, ZB_PACKET_ACKNOWLEDGED, junk, sizeof(junk));
+    sim.atResponse(1, "CH", AT_OK, vr, 1);
+    sim.repeat(true);
+
+    xb.setSerial(sim);
+    xb.isTimeServer = true;
+    xb.disassocReset = false;
+    xb.txWindow = 0;                        //the script's statuses don't match our frame IDs
+}
+
+void loop()
+{
+    if (done) return;
+
+    uint16_t nFrames = 0;
+    uint32_t usTotal = 0;
+    while (nFrames < NFRAMES)
+    {
+        uint32_t bytesIn = sim.bytesRead;
+        uint32_t bytesOut = sim.bytesWritten;
+        uint32_t usStart = micros();
+        xbeeReadStatus_t s = xb.read();
+        uint32_t us = micros() - usStart;
+        if (s == NO_TRAFFIC) continue;
+        benchStat_t* st = &stats[s];
+        ++st->frames;
+        st->us += us;
+        usTotal += us;
+        st->bytesIn += sim.bytesRead - bytesIn;
+        st->bytesOut += sim.bytesWritten - bytesOut;
+        st->bytesCopied += bytesCopied(s);
+        if (s == RX_DATA) xb.pop();         //as a sketch would, so the queue doesn't fill
+        ++nFrames;
+    }
+
+    Serial << endl << F("Frames\t") << nFrames << endl;
+    Serial << F("Elapsed\t") << usTotal << F(" us\n");
+    if (usTotal > 0) Serial << F("Rate\t") << 1.0e6 * nFrames / usTotal << F(" frames/s\n");
+    Serial << F("\nStatus\t\t\tFrames\tns/frame\tIn/fr\tOut/fr\tCopy/fr\n");
+    for (uint8_t i = 0; i < NSTATUS; ++i)
+    {
+        benchStat_t* st = &stats[i];
+        if (st->frames == 0) continue;
+        Serial << statusNames[i] << (strlen(statusNames[i]) < 8 ? F("\t\t\t") : strlen(statusNames[i]) < 16 ? F("\t\t") : F("\t"));
+        Serial << st->frames << '\t' << 1000.0 * st->us / st->frames << '\t';
+        Serial << st->bytesIn / st->frames << '\t' << st->bytesOut / st->frames << '\t' << st->bytesCopied / st->frames << endl;
+    }
+
+    Serial << F("\nPacket\tBytes\tSent/rpt\tEncode us\tDecode us\n");
+    codecBench(false);
+    codecBench(true);
+    writerBench();
+    portBench();
+    fuzzBench();
+    done = true;
+}
+
@@ -0,0 +1,186 @@
+// Arduino XBee Library for GroveStreams Wireless Sensor Network.
+// Memory footprint report.
+//
+// This work by Jack Christensen is licensed under CC BY-SA 4.0,
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// Reports the size of a gsXBee object and its parts, the tunables it was
+// built with, and the peak stack used by each of the library's main call
+// paths. The frames are fed to the library by a simulated radio
+// (gsXBeeSim), so no XBee is needed. Use it to compare the default build
+// with GSXBEE_FULL (see gsXBee.h) or other tunable settings.
+//
+// Stack use is measured by painting up to PAINT_LEN bytes of unused stack
+// with a pattern, making the call, and finding how much of the pattern was
+// overwritten. It is approximate (within a few bytes) and includes any
+// diagnostic messages the library prints. On an AVR, only the free memory
+// between the heap and the stack, less PAINT_MARGIN bytes, is painted, and
+// stack use isn't measured if that is less than PAINT_MIN bytes. If a call
+// path uses all of the painted stack it is reported with a '+'.
+
+#include <gsXBee.h>
+#include <gsXBeeSim.h>
+#include <Streaming.h>                      //http://arduiniana.org/libraries/streaming/
+#include <XBee.h>                           //http://github.com/andrewrapp/xbee-arduino
+
+const uint32_t BAUD_RATE(115200);
+const uint16_t PAINT_LEN(1024);             //most bytes of stack to paint
+const uint8_t PAINT_MARGIN(64);             //bytes left unpainted above the heap, for interrupts
+const uint8_t PAINT_MIN(128);               //fewest bytes of stack worth painting
+const uint8_t PAINT(0xA5);
+
+#ifdef __AVR__
+extern char __heap_start;                   //from the linker
+extern char* __brkval;                      //top of the heap, NULL until malloc() is first called
+#endif
+
+uint8_t simBuf[128];
+gsXBeeSim sim(simBuf, sizeof(simBuf));
+gsXBee xb;
+XBeeAddress64 nodeAddr(0x0013A200, 0x40A1B2C3);
+const char* const dict[] = { "t", "h" };
+char longData[160];
+uintptr_t painted;                          //lowest address painted by paintStack()
+uint16_t paintLen;                          //bytes painted by paintStack()
+bool done;
+
+//returns the number of bytes of unused stack below the caller's frame that
+//can be painted: PAINT_LEN, or on an AVR, the free memory above the heap
+//less PAINT_MARGIN if that is smaller.
+uint16_t __attribute__((noinline)) paintRoom()
+{
+    uint16_t len = PAINT_LEN;
+#ifdef __AVR__
+    uint8_t here;
+    char* heapEnd = __brkval != NULL ? __brkval : &__heap_start;
+    int16_t room = (char*)&here - heapEnd - PAINT_MARGIN;
+    if (room < 0) room = 0;
+    if ((uint16_t)room < len) len = room;
+#endif
+    return len;
+}
+
+//fill the unused stack below the caller's frame with PAINT
+void __attribute__((noinline)) paintStack()
+{
+    uint8_t here;
+    paintLen = paintRoom();
+    painted = (uintptr_t)&here - paintLen;
+    for (uint16_t i = 0; i < paintLen; ++i) ((volatile uint8_t*)painted)[i] = PAINT;
+}
+
+//returns the number of bytes of the stack painted by paintStack() that have
+//since been overwritten, i.e. the peak stack use below the caller's frame.
+//must be called from the same function as paintStack().
+uint16_t stackUsed()
+{
+    uint16_t i = 0;
+    while (i < paintLen && ((volatile uint8_t*)painted)[i] == PAINT) ++i;
+    return paintLen - i;
+}
+
+void printUsed(const __FlashStringHelper* path, uint16_t used)
+{
+    Serial << path << '\t' << used << (used >= paintLen ? F("+\n") : F("\n"));
+}
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+    Serial << F( "\n" __FILE__ " " __DATE__ " " __TIME__ "\n" );
+
+    xb.setSerial(sim);
+    strcpy(xb.compID, "node1");
+    memset(longData, 'x', sizeof(longData) - 1);
+}
+
+void loop()
+{
+    if (done) return;
+
+#ifdef GSXBEE_FULL
+    Serial << F("\nProfile\t\tGSXBEE_FULL\n");
+#else
+    Serial << F("\nProfile\t\tdefault\n");
+#endif
+    Serial << F("AT slots\t") << GSXBEE_AT_SLOTS << endl;
+    Serial << F("TX slots\t") << GSXBEE_TX_SLOTS << endl;
+    Serial << F("RX slots\t") << GSXBEE_RX_SLOTS << endl;
+    Serial << F("MSG slots\t") << GSXBEE_MSG_SLOTS << endl;
+    Serial << F("TS slots\t") << GSXBEE_TS_SLOTS << endl;
+    Serial << F("ADDR slots\t") << GSXBEE_ADDR_SLOTS << endl;
+    Serial << F("ROUTE slots\t") << GSXBEE_ROUTE_SLOTS << endl;
+    Serial << F("OUT slots\t") << GSXBEE_OUT_SLOTS << endl;
+    Serial << F("FRAME slots\t") << GSXBEE_FRAME_SLOTS << endl;
+    Serial << F("SEND slots\t") << GSXBEE_SEND_SLOTS << endl;
+    Serial << F("AT handlers\t") << GSXBEE_AT_HANDLERS << endl;
+    Serial << F("Stats\t\t") << GSXBEE_STATS << endl;
+
+    Serial << F("\nObject sizes, bytes\n");
+    Serial << F("gsXBee\t\t") << sizeof(gsXBee) << endl;
+    Serial << F("  XBee base\t") << sizeof(XBee) << endl;
+    Serial << F("  RX queue\t") << GSXBEE_RX_SLOTS * sizeof(rxPacket_t) << endl;
+#if GSXBEE_MSG_SLOTS > 0
+    Serial << F("  MSG slots\t") << GSXBEE_MSG_SLOTS * sizeof(rxMessage_t) << F("+\n");
+#endif
+#if GSXBEE_STATS
+    Serial << F("  Stats\t\t") << sizeof(xbeeStats_t) << endl;
+#endif
+
+    Serial << F("\nStack, bytes\n");
+    if (paintRoom() < PAINT_MIN)
+    {
+        Serial << F("Not enough free memory to measure, ") << paintRoom() << F(" bytes\n");
+        done = true;
+        return;
+    }
+    uint8_t cmd[] = { 'N', 'I' };
+    uint8_t frameID = xb.sendCommand(cmd);
+    const char ni[] = "node1_10050000";
+    sim.clear();
+    sim.atResponse(frameID, "NI", 0, (const uint8_t*)ni, sizeof(ni) - 1);
+    paintStack();
+    xb.read();
+    printUsed(F("read() NI"), stackUsed());
+
+    sim.clear();
+    sim.packet(nodeAddr, 'D', "node2", "&t=21.5&h=45");
+    paintStack();
+    xb.read();
+    printUsed(F("read() D"), stackUsed());
+    xb.pop();
+
+    uint8_t bin[] = { 0 << 3 | 1, 0xAE, 0x03, 1 << 3, 0x5A };   //t=21.5, h=45
+    xb.setStreamDict(dict, 2);
+    sim.clear();
+    sim.packet(nodeAddr, 'B', "node2", bin, sizeof(bin));
+    paintStack();
+    xb.read();
+    printUsed(F("read() B"), stackUsed());
+    xb.pop();
+    xb.setStreamDict(NULL, 0);
+
+    paintStack();
+    frameID = xb.sendData((char*)"&t=21.5&h=45");
+    printUsed(F("sendData()"), stackUsed());
+
+    sim.clear();
+    sim.txStatus(frameID, 0);
+    paintStack();
+    xb.read();
+    printUsed(F("read() status"), stackUsed());
+
+    paintStack();
+    xb.sendData(longData);
+    printUsed(F("sendData() long"), stackUsed());
+
+    paintStack();
+    xb.batchAdd("t", 21.5);
+    xb.batchFlush();
+    printUsed(F("batch"), stackUsed());
+
+    paintStack();
+    xb.requestTimeSync(0);
+    printUsed(F("time sync"), stackUsed());
+    done = true;
+}
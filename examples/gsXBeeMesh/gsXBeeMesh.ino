@@ -0,0 +1,229 @@
+// Arduino XBee Library for GroveStreams Wireless Sensor Network.
+// Many-to-one routing simulation.
+//
+// This work by Jack Christensen is licensed under CC BY-SA 4.0,
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// Simulates a coordinator that answers every packet from NNODES nodes
+// scattered at random depths (1 to MAX_DEPTH hops) in a mesh, for MINUTES
+// minutes with each node reporting once a minute. No XBee is needed.
+//
+// The simulation is run twice with the same nodes and reporting order:
+//   1. Ordinary (AODV) routing. The coordinator's XBee keeps XB_ROUTES routes,
+//      least recently used replaced. Each reply to a node that is not in its
+//      route table starts a route discovery, which floods the network with a
+//      broadcast from every node and delays the reply.
+//   2. Many-to-one routing (setManyToOne). The coordinator makes a many-to-one
+//      broadcast every MTO_MINUTES minutes, after which each node sends a
+//      route record ahead of its next packet. The library keeps the routes and
+//      gives them to the XBee as source routes, so replies need no discovery.
+//      Nodes whose routes are not in the library's table fall back to ordinary
+//      routing.
+//
+// The packets, route records and TX statuses pass through the library via
+// a simulated radio (gsXBeeSim); the radio links are modeled. Reports the
+// broadcasts and mean reply latency for each run.
+//
+// The library keeps GSXBEE_ROUTE_SLOTS routes (none by default, 4 with
+// GSXBEE_FULL); build it with GSXBEE_FULL defined (see gsXBee.h). For the
+// full benefit, the coordinator needs as many as there are nodes.
+
+#include <gsXBee.h>
+#include <gsXBeeSim.h>
+#include <Streaming.h>                      //http://arduiniana.org/libraries/streaming/
+#include <XBee.h>                           //http://github.com/andrewrapp/xbee-arduino
+
+const uint32_t BAUD_RATE(115200);
+const uint8_t NNODES(12);
+const uint8_t MAX_DEPTH(4);                 //hops from the coordinator, at most GSXBEE_ROUTE_HOPS + 1
+const uint16_t MINUTES(60);                 //simulated time
+const uint8_t MTO_MINUTES(10);              //many-to-one broadcast interval
+const uint8_t XB_ROUTES(8);                 //route table entries in the coordinator's XBee
+const uint16_t HOP_MS(10);                  //unicast delay per hop
+const uint16_t BCAST_MS(40);                //broadcast delay per hop, including jitter
+
+struct node_t
+{
+    char compID[9];
+    XBeeAddress64 addr;
+    uint16_t addr16;
+    uint8_t depth;
+    uint16_t hops[MAX_DEPTH];               //16-bit addresses of the intermediate nodes
+    bool recordDue;                         //send a route record with the next packet
+};
+node_t nodes[NNODES];
+
+uint8_t simBuf[128];
+gsXBeeSim sim(simBuf, sizeof(simBuf));
+gsXBee coord;
+uint8_t xbRoutes[XB_ROUTES];                //the XBee's route table, node indexes, most recently used first
+uint8_t xbRouteCount;
+bool done;
+
+struct result_t
+{
+    uint16_t replies;
+    uint16_t sourceRouted;
+    uint16_t discoveries;
+    uint32_t broadcasts;
+    uint32_t latency;                       //sum of reply latencies, ms
+};
+
+//look up node n in the modeled XBee route table and move it to the front,
+//adding it if it's not there. returns false if it was not there.
+bool xbRoute(uint8_t n)
+{
+    uint8_t i = 0;
+    while (i < xbRouteCount && xbRoutes[i] != n) ++i;
+    bool found = i < xbRouteCount;
+    if (!found)
+    {
+        if (xbRouteCount < XB_ROUTES) ++xbRouteCount;
+        i = xbRouteCount - 1;
+    }
+    for (; i > 0; --i) xbRoutes[i] = xbRoutes[i - 1];
+    xbRoutes[0] = n;
+    return found;
+}
+
+//feed node n's route record to the coordinator
+void routeRecord(node_t &n)
+{
+    uint8_t d[12 + 2 * MAX_DEPTH];
+    uint32_t msb = n.addr.getMsb(), lsb = n.addr.getLsb();
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+        d[i] = msb >> (24 - 8 * i);
+        d[4 + i] = lsb >> (24 - 8 * i);
+    }
+    d[8] = n.addr16 >> 8;
+    d[9] = n.addr16;
+    d[10] = 0;
+    d[11] = n.depth - 1;
+    for (uint8_t i = 0; i < n.depth - 1; ++i)
+    {
+        d[12 + 2 * i] = n.hops[i] >> 8;
+        d[13 + 2 * i] = n.hops[i];
+    }
+    sim.frame(XB_ROUTE_RECORD, d, 12 + 2 * (n.depth - 1));
+}
+
+//read frames until the given status is returned
+bool readUntil(xbeeReadStatus_t stat)
+{
+    for (uint8_t i = 0; i < 10; ++i)
+    {
+        if (coord.read() == stat) return true;
+    }
+    Serial << F("Simulation error\n");
+    return false;
+}
+
+//simulate the network for MINUTES minutes, with or without many-to-one routing
+void simulate(bool manyToOne, result_t &r)
+{
+    memset(&r, 0, sizeof(r));
+    xbRouteCount = 0;
+    randomSeed(1);
+    for (uint16_t m = 0; m < MINUTES; ++m)
+    {
+        if (manyToOne && m % MTO_MINUTES == 0)
+        {
+            r.broadcasts += NNODES + 1;                     //every node rebroadcasts it
+            for (uint8_t i = 0; i < NNODES; ++i) nodes[i].recordDue = true;
+        }
+
+        //each node reports once, in random order
+        uint8_t order[NNODES];
+        for (uint8_t i = 0; i < NNODES; ++i) order[i] = i;
+        for (uint8_t i = NNODES - 1; i > 0; --i)
+        {
+            uint8_t j = random(i + 1);
+            uint8_t t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+
+        for (uint8_t k = 0; k < NNODES; ++k)
+        {
+            node_t &n = nodes[order[k]];
+            sim.clear();
+            if (n.recordDue) routeRecord(n);
+            n.recordDue = false;
+            sim.packet(n.addr, 'D', n.compID, "&t=21.5", ZB_PACKET_ACKNOWLEDGED, n.addr16);
+            if ( !readUntil(RX_DATA) ) return;
+            coord.pop();
+
+            //the coordinator answers
+            bool sourceRouted = coord.routeHops(n.addr) >= 0;
+            uint8_t frameID = coord.sendTo(n.compID, (char*)"&ack=1");
+            uint32_t latency = n.depth * HOP_MS;
+            uint8_t dscy = 0;
+            if (sourceRouted)
+            {
+                ++r.sourceRouted;
+            }
+            else if ( !xbRoute(order[k]) )
+            {
+                ++r.discoveries;
+                r.broadcasts += NNODES + 1;
+                latency += n.depth * (BCAST_MS + HOP_MS);   //route request out, route reply back
+                dscy = 2;                                   //route discovery
+            }
+            sim.clear();
+            sim.txStatus(frameID, 0, dscy, 0, n.addr16);
+            if ( !readUntil(TX_ACK) ) return;
+            ++r.replies;
+            r.latency += latency;
+        }
+    }
+}
+
+void report(const __FlashStringHelper* title, result_t &r)
+{
+    Serial << endl << title << endl;
+    Serial << F("Replies\t\t") << r.replies << endl;
+    Serial << F("Source routed\t") << r.sourceRouted << endl;
+    Serial << F("Discoveries\t") << r.discoveries << endl;
+    Serial << F("Broadcasts\t") << r.broadcasts << endl;
+    if (r.replies > 0) Serial << F("Mean latency\t") << (float)r.latency / r.replies << F(" ms\n");
+}
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+    Serial << F( "\n" __FILE__ " " __DATE__ " " __TIME__ "\n" );
+
+    randomSeed(analogRead(0));
+    for (uint8_t i = 0; i < NNODES; ++i)
+    {
+        node_t &n = nodes[i];
+        sprintf(n.compID, "node%u", i + 1);
+        n.addr = XBeeAddress64(0x0013A200, 0x40000001 + i);
+        n.addr16 = 0x1000 + i;
+        n.depth = random(1, MAX_DEPTH + 1);
+        for (uint8_t h = 0; h < n.depth - 1; ++h) n.hops[h] = 0x2000 + random(0x1000);
+    }
+
+    coord.setSerial(sim);
+    strcpy(coord.compID, "coord");
+    coord.rssPolicy = RSS_OFF;
+}
+
+void loop()
+{
+    if (done) return;
+
+    Serial << endl << NNODES << F(" nodes, ") << MINUTES << F(" minutes, library route table ")
+        << GSXBEE_ROUTE_SLOTS << F(", XBee route table ") << XB_ROUTES << endl;
+#if GSXBEE_ROUTE_SLOTS == 0
+    Serial << F("No library route table, build the library with GSXBEE_FULL\n");
+#endif
+    result_t aodv, mto;
+    simulate(false, aodv);
+    report(F("Ordinary routing"), aodv);
+    coord.setManyToOne(MTO_MINUTES * 6);
+    simulate(true, mto);
+    report(F("Many-to-one routing"), mto);
+    done = true;
+}
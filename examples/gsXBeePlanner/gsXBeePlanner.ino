@@ -0,0 +1,156 @@
+// Arduino XBee Library for GroveStreams Wireless Sensor Network.
+// Transmission schedule planner.
+//
+// This work by Jack Christensen is licensed under CC BY-SA 4.0,
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// Checks the transmission schedules of all the nodes on a network (PAN)
+// before deployment. Edit the list of Node Identifiers (NI) below, upload,
+// and open the serial monitor. No XBee is needed.
+//
+// Reports:
+//   - Node IDs that are not in the compID_ssmmnnww format.
+//   - Each pair of nodes whose transmissions ever fall in the same second,
+//     and how often that happens.
+//   - The channel load for each second of the minute that has nodes
+//     scheduled: the number of nodes, the average transmissions per minute,
+//     and the most transmissions in any one minute (peak). The peak is found
+//     by stepping through the schedule for up to MAX_MINUTES minutes.
+//
+// For a congestion-free schedule, there should be no collisions and every
+// peak should be one. Move colliding nodes to an unused second (listed at
+// the end), or give them offsets that differ modulo the greatest common
+// divisor of their intervals.
+
+#include <gsXBee.h>
+#include <Streaming.h>                      //http://arduiniana.org/libraries/streaming/
+#include <XBee.h>                           //http://github.com/andrewrapp/xbee-arduino
+
+const uint32_t BAUD_RATE(115200);
+const uint32_t MAX_MINUTES(10080);          //a week
+
+//the Node IDs for the network
+const char* const pan[] =
+{
+    "boiler_00010000", "attic_10010005", "garage_10050000", "porch_10050100",
+    "shed_10050000", "pond_20030000", "cellar_20060300", "meter_30150005",
+    "office_30100400", "barn_30100900", "well_40070300", "gate_40070300",
+};
+const uint8_t NNODES(sizeof(pan) / sizeof(pan[0]));
+
+struct node_t
+{
+    uint8_t sec;
+    uint8_t interval;
+    uint8_t offset;
+    bool valid;
+};
+node_t nodes[NNODES];
+bool done;
+
+//parse the schedule from a Node ID in the format compID_ssmmnnww.
+//returns false if the format or the values are not valid.
+bool parseNI(const char* ni, node_t &n)
+{
+    uint8_t len = strlen(ni);
+    if (len < 10 || len > 17 || ni[len - 9] != '_') return false;
+    uint8_t v[4];
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+        char hi = ni[len - 8 + 2 * i], lo = ni[len - 7 + 2 * i];
+        if (hi < '0' || hi > '9' || lo < '0' || lo > '9') return false;
+        v[i] = (hi - '0') * 10 + lo - '0';
+    }
+    n.sec = v[0];
+    n.interval = v[1];
+    n.offset = v[2];
+    return n.sec < 60 && n.interval >= 1 && n.offset < n.interval;
+}
+
+uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0)
+    {
+        uint32_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+    Serial << F( "\n" __FILE__ " " __DATE__ " " __TIME__ "\n" );
+}
+
+void loop()
+{
+    if (done) return;
+
+    Serial << endl << NNODES << F(" nodes\n");
+    for (uint8_t i = 0; i < NNODES; ++i)
+    {
+        nodes[i].valid = parseNI(pan[i], nodes[i]);
+        if (!nodes[i].valid) Serial << F("Invalid Node ID\t") << pan[i] << endl;
+    }
+
+    Serial << F("\nCollisions\n");
+    uint16_t nCollisions = 0;
+    for (uint8_t i = 0; i < NNODES; ++i)
+    {
+        node_t &a = nodes[i];
+        for (uint8_t j = i + 1; j < NNODES; ++j)
+        {
+            node_t &b = nodes[j];
+            if (!a.valid || !b.valid) continue;
+            if (gsXBee::slotsCollide(a.sec, a.interval, a.offset, b.sec, b.interval, b.offset))
+            {
+                uint32_t every = (uint32_t)a.interval / gcd(a.interval, b.interval) * b.interval;
+                Serial << pan[i] << F(" x ") << pan[j] << F("\tevery ") << every << F(" min\n");
+                ++nCollisions;
+            }
+        }
+    }
+    if (nCollisions == 0) Serial << F("None\n");
+
+    Serial << F("\nSecond\tNodes\tTX/min\tPeak\n");
+    uint8_t worstPeak = 0;
+    for (uint8_t s = 0; s < 60; ++s)
+    {
+        uint8_t n = 0;
+        float perMinute = 0;
+        uint32_t period = 1;                                //the schedule for this second repeats after this many minutes
+        for (uint8_t i = 0; i < NNODES; ++i)
+        {
+            if (!nodes[i].valid || nodes[i].sec != s) continue;
+            ++n;
+            perMinute += 1.0 / nodes[i].interval;
+            if (period <= MAX_MINUTES) period = period / gcd(period, nodes[i].interval) * nodes[i].interval;
+        }
+        if (n == 0) continue;
+
+        uint8_t peak = 0;
+        for (uint32_t m = 0; m < period && m < MAX_MINUTES; ++m)
+        {
+            uint8_t k = 0;
+            for (uint8_t i = 0; i < NNODES; ++i)
+            {
+                if (nodes[i].valid && nodes[i].sec == s && gsXBee::nextSlot(m * 60 + s, s, nodes[i].interval, nodes[i].offset) == m * 60 + s) ++k;
+            }
+            if (k > peak) peak = k;
+        }
+        if (peak > worstPeak) worstPeak = peak;
+        Serial << s << '\t' << n << '\t' << perMinute << '\t' << peak << (period > MAX_MINUTES ? F("+\n") : F("\n"));
+    }
+
+    Serial << F("\nUnused seconds\t");
+    for (uint8_t s = 0; s < 60; ++s)
+    {
+        bool used = false;
+        for (uint8_t i = 0; i < NNODES; ++i) used |= nodes[i].valid && nodes[i].sec == s;
+        if (!used) Serial << s << ' ';
+    }
+    Serial << F("\n\nWorst peak\t") << worstPeak << (worstPeak > 1 ? F(" (collisions)\n") : F(" (congestion-free)\n"));
+    done = true;
+}
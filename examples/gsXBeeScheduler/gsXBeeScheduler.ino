@@ -0,0 +1,266 @@
+// Arduino XBee Library for GroveStreams Wireless Sensor Network.
+// Transmit scheduler simulation.
+//
+// This work by Jack Christensen is licensed under CC BY-SA 4.0,
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// Simulates a time server that also forwards data, sends long (fragmented)
+// messages, and queries the RSS with the DB command, for NSECONDS seconds.
+// Each second, at random times, a node's time sync request arrives, a data
+// packet is sent and followed by a DB command, and with probability
+// BULK_PCT a long message of BULK_MIN to BULK_MAX bytes is sent. At each
+// second rollover, sendTimeSync() answers the request.
+//
+// The XBee is modeled (RadioModel, below) as a first-in, first-out queue of
+// frames: it transmits one at a time, each taking AIR_MIN to AIR_MAX ms
+// until its TX status, and answers AT commands in AT_MS ms. The reply's
+// timestamp is taken as the frame goes to the XBee, so any time it then
+// waits in the XBee behind other frames is error in the time the node gets.
+//
+// The simulation is run with txWindow = 0 (every frame goes to the XBee at
+// once, as without the scheduler) and with the default txWindow. Reports the
+// mean and worst time from sendTimeSync() to the reply leaving the XBee, the
+// mean and worst timestamp error, and the mean and worst latency of data
+// packets and message fragments (from the send call to their TX status).
+// The send queue needs GSXBEE_SEND_SLOTS > 0, so build the library with
+// GSXBEE_FULL defined (see gsXBee.h). With more slots, fewer frames find
+// the send queue full.
+
+#include <gsXBee.h>
+#include <gsXBeeSim.h>
+#include <Streaming.h>                      //http://arduiniana.org/libraries/streaming/
+#include <XBee.h>                           //http://github.com/andrewrapp/xbee-arduino
+
+const uint32_t BAUD_RATE(115200);
+const uint16_t NSECONDS(120);               //simulated time
+const uint8_t AIR_MIN(20);                  //time for the XBee to transmit a packet and report its status, ms
+const uint8_t AIR_MAX(80);
+const uint8_t AT_MS(2);                     //time for the XBee to answer an AT command, ms
+const uint8_t BULK_PCT(50);                 //chance of a long message in a given second, percent
+const uint8_t BULK_MIN(100);                //length of a long message, bytes
+const uint8_t BULK_MAX(240);
+const uint8_t RADIO_FRAMES(16);             //frames the modeled XBee can hold
+
+struct radioFrame_t                         //a frame waiting in the modeled XBee
+{
+    uint8_t apiID;
+    uint8_t frameID;
+    char packetType;                        //for a TX request
+    uint32_t stamp[2];                      //time fields of a time sync packet
+};
+
+//models an XBee that transmits the frames written to it in order, and
+//scripts their TX statuses and AT responses for gsXBee to read
+class RadioModel : public gsXBeeSim
+{
+public:
+    RadioModel(uint8_t* buf, uint16_t bufSize) : gsXBeeSim(buf, bufSize), count(0), busy(false), busyUntil(0) {}
+
+    size_t write(uint8_t b)
+    {
+        if (framer.put(b, frameData) != 1 || count >= RADIO_FRAMES) return 1;
+        radioFrame_t* f = &fifo[count++];
+        f->apiID = framer.apiID;
+        f->frameID = frameData[0];
+        f->packetType = 0;
+        if (f->apiID == ZB_TX_REQUEST)
+        {
+            uint8_t* payload = frameData + 13;              //after frame ID, addresses, radius and options
+            uint8_t* stx = (uint8_t*)memchr(payload, STX, framer.dataLen - 13);
+            f->packetType = payload[1];
+            if (f->packetType == 'S' && stx != NULL) memcpy(f->stamp, stx + 1, sizeof(f->stamp));
+        }
+        return 1;
+    }
+    using Print::write;
+
+    //advance the model to the current time. returns the frame the XBee
+    //started to transmit, or NULL.
+    radioFrame_t* step(uint32_t ms)
+    {
+        if (count == 0 || ms < busyUntil) return NULL;
+        if (busy)                                           //the frame at the head is done
+        {
+            if (available() == 0) clear();
+            if (fifo[0].apiID == AT_COMMAND_REQUEST)
+            {
+                uint8_t db[] = { 0x48 };
+                atResponse(fifo[0].frameID, "DB", AT_OK, db, sizeof(db));
+            }
+            else
+            {
+                txStatus(fifo[0].frameID, SUCCESS);
+            }
+            memmove(fifo, fifo + 1, --count * sizeof(radioFrame_t));
+            busy = false;
+            if (count == 0) return NULL;
+        }
+        busy = true;
+        busyUntil = ms + (fifo[0].apiID == AT_COMMAND_REQUEST ? AT_MS : random(AIR_MIN, AIR_MAX + 1));
+        return &fifo[0];
+    }
+    void reset() { count = 0; busy = false; busyUntil = 0; clear(); }
+    bool idle() { return count == 0; }
+
+private:
+    gsXBeeFramer framer;
+    uint8_t frameData[MAX_FRAME_DATA_SIZE];
+    radioFrame_t fifo[RADIO_FRAMES];
+    uint8_t count;
+    bool busy;
+    uint32_t busyUntil;
+};
+
+struct result_t
+{
+    uint16_t syncs;
+    uint32_t waitSum;                       //sendTimeSync() to the reply leaving the XBee, ms
+    uint32_t waitMax;
+    uint32_t errSum;                        //time the reply left the XBee minus its timestamp, ms
+    uint32_t errMax;
+    uint16_t packets[2];                    //data packets, fragments
+    uint32_t latencySum[2];                 //send call to TX status, ms
+    uint32_t latencyMax[2];
+};
+
+uint8_t radioBuf[128];
+RadioModel radio(radioBuf, sizeof(radioBuf));
+gsXBee server;
+XBeeAddress64 nodeAddr(0x0013A200, 0x40A1B2C3);
+char bulk[BULK_MAX + 1];
+uint32_t msSecond;                          //millis() at the start of the current second
+uint32_t utc;                               //the current second
+result_t* res;
+uint32_t sentAt[256];                       //when each frame ID was sent, from millis()
+uint8_t lastFrameID;                        //the last frame ID noted by noteSent()
+uint8_t defaultWindow;                      //the library's default txWindow
+bool done;
+
+//note the send time of the frame IDs used since the last call, through frameID
+void noteSent(uint8_t frameID)
+{
+    while (lastFrameID != frameID)
+    {
+        if (++lastFrameID == 0) lastFrameID = 1;            //frame IDs skip zero
+        sentAt[lastFrameID] = millis();
+    }
+}
+
+//record the latency of each data packet and fragment, including any time
+//it waited in the send queue
+void txDone(txResult_t &r)
+{
+    uint8_t i = r.packetType == 'F';
+    uint32_t latency = millis() - sentAt[r.frameID];
+    ++res->packets[i];
+    res->latencySum[i] += latency;
+    res->latencyMax[i] = max(res->latencyMax[i], latency);
+}
+
+//a node's time sync request, with its origin, arrives at the XBee
+void syncRequest()
+{
+    uint32_t body[2] = { 0, millis() };
+    if (radio.available() == 0) radio.clear();
+    radio.packet(nodeAddr, 'S', "node1", (uint8_t*)body, sizeof(body));
+}
+
+//simulate NSECONDS seconds with the given transmit window
+void simulate(uint8_t window, result_t &r)
+{
+    memset(&r, 0, sizeof(r));
+    res = &r;
+    radio.reset();
+    server.txWindow = window;
+    randomSeed(1);                          //the same traffic for each run
+
+    for (uint16_t s = 0; s < NSECONDS; ++s)
+    {
+        uint16_t msSync = random(1000);     //when things happen in this second
+        uint16_t msData = random(1000);
+        uint16_t msBulk = random(100) < BULK_PCT ? random(1000) : 1000;
+        msSecond = millis();
+        utc = 1000000 + s;
+        for (uint16_t ms = 0; ms < 1000; ++ms)
+        {
+            if (ms == msSync) syncRequest();
+            if (ms == msData)
+            {
+                noteSent(server.sendData((char*)"&t=21.5&h=45&p=1013.2"));
+                uint8_t db[] = { 'D', 'B' };
+                noteSent(server.sendCommand(db));
+            }
+            if (ms == msBulk)
+            {
+                uint8_t len = random(BULK_MIN, BULK_MAX + 1);
+                memset(bulk, 'x', len);
+                bulk[len] = 0;
+                noteSent(server.sendData(bulk));
+            }
+            if (ms == 0 && s > 0) noteSent(server.sendTimeSync(utc));
+            while (server.read() != NO_TRAFFIC) server.pop();
+            radioFrame_t* f = radio.step(millis());
+            if (f != NULL && f->packetType == 'S')
+            {
+                uint32_t sent = millis();
+                uint32_t stamped = msSecond + (f->stamp[0] - utc) * 1000 + (f->stamp[1] & 0xFFFF);
+                ++r.syncs;
+                r.waitSum += sent - msSecond;
+                r.waitMax = max(r.waitMax, sent - msSecond);
+                r.errSum += sent - stamped;
+                r.errMax = max(r.errMax, sent - stamped);
+            }
+            delay(1);
+        }
+    }
+    while ( !radio.idle() || server.txPending() )           //let the last frames finish
+    {
+        server.read();
+        radio.step(millis());
+        delay(1);
+    }
+}
+
+void report(uint8_t window, result_t &r)
+{
+    Serial << window << (window ? F("\t\t") : F(" (none)\t")) << r.syncs << '\t';
+    Serial << (r.syncs ? r.waitSum / r.syncs : 0) << '\t' << r.waitMax << '\t';
+    Serial << (r.syncs ? r.errSum / r.syncs : 0) << '\t' << r.errMax << '\t';
+    for (uint8_t i = 0; i < 2; ++i)
+    {
+        Serial << (r.packets[i] ? r.latencySum[i] / r.packets[i] : 0) << '\t' << r.latencyMax[i] << (i ? '\n' : '\t');
+    }
+}
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+    Serial << F( "\n" __FILE__ " " __DATE__ " " __TIME__ "\n" );
+
+    defaultWindow = server.txWindow;
+    server.setSerial(radio);
+    strcpy(server.compID, "server");
+    server.isTimeServer = true;
+    server.rssPolicy = RSS_OFF;
+    server.retryLimit = 1;
+    server.setTxCallback(txDone);
+    server.setLog(NULL);
+}
+
+void loop()
+{
+    if (done) return;
+
+    Serial << NSECONDS << F(" seconds, ") << GSXBEE_SEND_SLOTS << F(" send slots\n");
+#if GSXBEE_SEND_SLOTS == 0
+    Serial << F("No send queue, build the library with GSXBEE_FULL\n");
+#endif
+    Serial << F("\t\tSync reply, ms\t\t\tData, ms\tFragments, ms\n");
+    Serial << F("txWindow\tSyncs\tWait\tMax\tErr\tMax\tMean\tMax\tMean\tMax\n");
+    result_t r;
+    simulate(0, r);
+    report(0, r);
+    simulate(defaultWindow, r);
+    report(defaultWindow, r);
+    done = true;
+}
@@ -0,0 +1,192 @@
+// Arduino XBee Library for GroveStreams Wireless Sensor Network.
+// Frame loss stress test.
+//
+// This work by Jack Christensen is licensed under CC BY-SA 4.0,
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// Streams NFRAMES D packets, one every FRAME_MS milliseconds at BAUD_RATE,
+// from a simulated XBee into a simulated UART receive buffer of UART_BUF
+// bytes (as in the Arduino core for an ATmega328), while the sketch that
+// reads them stalls at random (as if printing or reading sensors) for up
+// to MAX_STALL milliseconds after one packet in STALL_ODDS. Time is
+// simulated one byte time at a time, so the results don't depend on the
+// speed of the machine it runs on. No XBee is needed.
+//
+// The test is run twice with the same packets and stalls:
+//   1. Polled. Bytes leave the UART buffer only when read() is called;
+//      whatever arrives while it's full is lost.
+//   2. Frame queue. A (simulated) timer interrupt calls rxPump() every
+//      PUMP_MS milliseconds, moving the bytes to the frame queue, which
+//      holds GSXBEE_FRAME_SLOTS complete frames until read() is called.
+// Reports packets received and lost, UART buffer overruns, and frames
+// dropped by the frame queue. The frame queue must be enabled by setting
+// GSXBEE_FRAME_SLOTS in gsXBee.h (e.g. 4), otherwise only the first test
+// is run.
+
+#include <gsXBee.h>
+#include <gsXBeeSim.h>
+#include <Streaming.h>                      //http://arduiniana.org/libraries/streaming/
+#include <XBee.h>                           //http://github.com/andrewrapp/xbee-arduino
+
+const uint32_t BAUD_RATE(115200);
+const uint16_t NFRAMES(2000);               //packets to send
+const uint8_t FRAME_MS(10);                 //interval between packets
+const uint8_t UART_BUF(64);                 //UART receive buffer size
+const uint8_t MAX_STALL(50);                //longest stall, ms
+const uint8_t STALL_ODDS(10);               //chance of a stall after each packet is 1 in this
+const uint8_t PUMP_MS(1);                   //timer interrupt interval
+const uint32_t BYTE_NS(10000000000ULL / BAUD_RATE); //one byte time (10 bits), ns
+
+//the UART receive buffer, filled by the simulated XBee
+class UartSim : public Stream
+{
+public:
+    UartSim() : overruns(0), head(0), count(0) {}
+    void put(uint8_t b)
+    {
+        if (count >= UART_BUF)
+        {
+            ++overruns;
+            return;
+        }
+        buf[(head + count++) % UART_BUF] = b;
+    }
+    int available() { return count; }
+    int read()
+    {
+        if (count == 0) return -1;
+        uint8_t b = buf[head];
+        head = (head + 1) % UART_BUF;
+        --count;
+        return b;
+    }
+    int peek() { return count ? buf[head] : -1; }
+    size_t write(uint8_t) { return 1; }
+    void flush() {}
+    using Print::write;
+    void clear() { head = count = 0; overruns = 0; }
+
+    uint32_t overruns;                      //bytes lost because the buffer was full
+
+private:
+    uint8_t buf[UART_BUF];
+    uint8_t head;
+    uint8_t count;
+};
+
+struct result_t
+{
+    uint16_t received;
+    uint16_t lost;                          //packets with sequence numbers that never arrived
+    uint32_t overruns;
+    uint16_t dropped;                       //frames dropped by the frame queue
+    uint16_t errors;                        //partial or corrupt frames discarded by the frame queue
+};
+
+uint8_t radioBuf[64];
+gsXBeeSim radio(radioBuf, sizeof(radioBuf));    //holds the packet being sent
+UartSim uart;
+gsXBee xb;
+XBeeAddress64 nodeAddr(0x0013A200, 0x40A1B2C3);
+bool done;
+
+//send the packets and read them, with or without the frame queue pumped by a timer interrupt
+void simulate(bool pumped, result_t &r)
+{
+    memset(&r, 0, sizeof(r));
+    randomSeed(1);
+    uart.clear();
+    radio.clear();
+#if GSXBEE_FRAME_SLOTS > 0
+    xb.frameOverruns = xb.frameErrors = 0;
+#endif
+    uint64_t ns = 0;                        //simulated time
+    uint64_t nextFrame = 0;                 //when the next packet starts
+#if GSXBEE_FRAME_SLOTS > 0
+    uint64_t nextPump = 0;
+#else
+    (void)pumped;                           //no frame queue to pump
+#endif
+    uint64_t stallUntil = 0;
+    uint16_t sent = 0;
+    int32_t lastSeq = -1;
+
+    while (sent < NFRAMES || ns < nextFrame + 2 * MAX_STALL * 1000000ULL)     //then allow time to catch up
+    {
+        ns += BYTE_NS;
+        if (!radio.available() && sent < NFRAMES && ns >= nextFrame)    //the XBee starts the next packet
+        {
+            char data[16];
+            sprintf(data, "&seq=%u", sent++);
+            radio.clear();
+            radio.packet(nodeAddr, 'D', "node1", data);
+            nextFrame += FRAME_MS * 1000000ULL;
+        }
+        if (radio.available()) uart.put(radio.read());
+
+#if GSXBEE_FRAME_SLOTS > 0
+        if (pumped && ns >= nextPump)      //the timer interrupt
+        {
+            xb.rxPump();
+            nextPump += PUMP_MS * 1000000ULL;
+        }
+#endif
+        if (ns < stallUntil) continue;      //the sketch is busy
+        if (xb.read() == RX_DATA)
+        {
+            int32_t seq = atol(xb.peek()->data + 5);
+            r.lost += seq - lastSeq - 1;
+            lastSeq = seq;
+            ++r.received;
+            xb.pop();
+            if (random(STALL_ODDS) == 0) stallUntil = ns + random(1, MAX_STALL + 1) * 1000000ULL;
+        }
+    }
+    r.lost += NFRAMES - 1 - lastSeq;        //lost from the end
+    r.overruns = uart.overruns;
+#if GSXBEE_FRAME_SLOTS > 0
+    r.dropped = xb.frameOverruns;
+    r.errors = xb.frameErrors;
+#endif
+}
+
+void report(const __FlashStringHelper* title, result_t &r)
+{
+    Serial << endl << title << endl;
+    Serial << F("Received\t") << r.received << endl;
+    Serial << F("Lost\t\t") << r.lost << F(" (") << 100.0 * r.lost / NFRAMES << F("%)\n");
+    Serial << F("UART overruns\t") << r.overruns << F(" bytes\n");
+#if GSXBEE_FRAME_SLOTS > 0
+    Serial << F("Queue drops\t") << r.dropped << endl;
+    Serial << F("Frame errors\t") << r.errors << endl;
+#endif
+}
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+    Serial << F( "\n" __FILE__ " " __DATE__ " " __TIME__ "\n" );
+
+    xb.setSerial(uart);
+    xb.rssPolicy = RSS_OFF;
+    xb.setLog(NULL);
+}
+
+void loop()
+{
+    if (done) return;
+
+    Serial << endl << NFRAMES << F(" packets every ") << FRAME_MS << F(" ms, stalls up to ")
+        << MAX_STALL << F(" ms, frame queue ") << GSXBEE_FRAME_SLOTS << endl;
+    result_t polled;
+    simulate(false, polled);
+    report(F("Polled"), polled);
+#if GSXBEE_FRAME_SLOTS > 0
+    result_t queued;
+    simulate(true, queued);
+    report(F("Frame queue"), queued);
+#else
+    Serial << F("\nSet GSXBEE_FRAME_SLOTS in gsXBee.h to also test the frame queue.\n");
+#endif
+    done = true;
+}
@@ -0,0 +1,142 @@
+// Arduino XBee Library for GroveStreams Wireless Sensor Network.
+// Time sync accuracy simulation.
+//
+// This work by Jack Christensen is licensed under CC BY-SA 4.0,
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// Runs NSYNCS time sync exchanges between a node and a time server whose
+// clock is offset from the node's by a random amount. Each exchange has
+// random link delays in each direction (DELAY_MIN to DELAY_MAX ms, so the
+// delays are usually asymmetric) and a random time that the server holds
+// the request before answering. The packets pass through the library on
+// both ends via simulated radios (gsXBeeSim). No XBee is needed.
+//
+// For each exchange, the time given to the node's precise time sync
+// callback is compared with the server's actual time, and the error is
+// checked against the error estimate. Reports the mean and maximum error,
+// the number of exchanges whose error exceeded the estimate (should be
+// zero), and the number of replies rejected for exceeding tsMaxDelay,
+// along with the error of the uncompensated (whole second) time.
+
+#include <gsXBee.h>
+#include <gsXBeeSim.h>
+#include <Streaming.h>                      //http://arduiniana.org/libraries/streaming/
+#include <XBee.h>                           //http://github.com/andrewrapp/xbee-arduino
+
+const uint32_t BAUD_RATE(115200);
+const uint16_t NSYNCS(200);                 //exchanges to simulate
+const uint16_t DELAY_MIN(5);                //one-way link delay, ms
+const uint16_t DELAY_MAX(150);
+const uint16_t HOLD_MAX(1000);              //longest time the server holds a request, ms
+
+uint8_t nodeBuf[64];
+uint8_t serverBuf[64];
+gsXBeeSim nodeSim(nodeBuf, sizeof(nodeBuf));
+gsXBeeSim serverSim(serverBuf, sizeof(serverBuf));
+gsXBee node;
+gsXBee server;
+XBeeAddress64 nodeAddr(0x0013A200, 0x40A1B2C3);
+XBeeAddress64 serverAddr(0x00000000, 0x00000000);
+
+int32_t serverOffset;                       //server clock minus node's millis(), ms
+bool synced;                                //the node's callback was called
+int32_t syncErr;                            //callback time minus server time, ms
+uint16_t syncErrEst;                        //error estimated by the library, ms
+int32_t coarseErr;                          //whole-second time minus server time, ms
+bool done;
+
+//the server's clock, in ms
+uint32_t serverClock()
+{
+    return millis() + serverOffset;
+}
+
+//the node's precise time sync callback
+void preciseSync(uint32_t utc, uint16_t ms, uint16_t errMs)
+{
+    synced = true;
+    syncErr = (int32_t)(utc * 1000 + ms - serverClock());
+    syncErrEst = errMs;
+    coarseErr = (int32_t)(utc * 1000 - serverClock());
+}
+
+//the body (after STX) of the packet just sent by xb
+uint8_t* body(gsXBee &xb)
+{
+    return (uint8_t*)xb.payload + 3 + strlen(xb.compID);
+}
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+    Serial << F( "\n" __FILE__ " " __DATE__ " " __TIME__ "\n" );
+    randomSeed(analogRead(0));
+
+    node.setSerial(nodeSim);
+    server.setSerial(serverSim);
+    strcpy(node.compID, "node1");
+    strcpy(server.compID, "server");
+    server.isTimeServer = true;
+    server.rssPolicy = RSS_OFF;
+    node.rssPolicy = RSS_OFF;
+    node.setSyncCallback(preciseSync);
+}
+
+void loop()
+{
+    if (done) return;
+
+    uint16_t nSynced = 0, nRejected = 0, nOver = 0;
+    uint32_t sumErr = 0, sumCoarse = 0, sumEst = 0;
+    uint16_t maxErr = 0;
+    for (uint16_t i = 0; i < NSYNCS; ++i)
+    {
+        serverOffset = random(-100000L, 100000L);
+        uint16_t up = random(DELAY_MIN, DELAY_MAX + 1);
+        uint16_t down = random(DELAY_MIN, DELAY_MAX + 1);
+        uint16_t hold = random(0, HOLD_MAX + 1);
+
+        //node sends the request, it arrives at the server after the uplink delay
+        node.requestTimeSync(0);
+        serverSim.clear();
+        serverSim.packet(nodeAddr, 'S', node.compID, body(node), 8);
+        delay(up);
+        while (server.read() != RX_TIMESYNC);
+
+        //server answers after holding the request, e.g. until the next second rollover
+        delay(hold);
+        uint32_t sc = serverClock();
+        server.sendTimeSync(sc / 1000, sc % 1000);
+        nodeSim.clear();
+        nodeSim.packet(serverAddr, 'S', server.compID, body(server), 12);
+        delay(down);
+        synced = false;
+        while (node.read() != RX_TIMESYNC);
+
+        if (!synced)
+        {
+            ++nRejected;
+            continue;
+        }
+        ++nSynced;
+        uint16_t e = abs(syncErr);
+        sumErr += e;
+        if (e > maxErr) maxErr = e;
+        if (e > syncErrEst) ++nOver;
+        sumEst += syncErrEst;
+        sumCoarse += abs(coarseErr);
+    }
+
+    Serial << endl << F("Exchanges\t") << NSYNCS << endl;
+    Serial << F("Link delay\t") << DELAY_MIN << '-' << DELAY_MAX << F(" ms each way\n");
+    Serial << F("Rejected\t") << nRejected << F(" (tsMaxDelay ") << node.tsMaxDelay << F(" ms)\n");
+    if (nSynced > 0)
+    {
+        Serial << F("Mean error\t") << (float)sumErr / nSynced << F(" ms\n");
+        Serial << F("Max error\t") << maxErr << F(" ms\n");
+        Serial << F("Mean estimate\t") << (float)sumEst / nSynced << F(" ms\n");
+        Serial << F("Over estimate\t") << nOver << endl;
+        Serial << F("Whole seconds\t") << (float)sumCoarse / nSynced << F(" ms mean error\n");
+    }
+    done = true;
+}
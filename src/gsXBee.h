@@ -11,8 +11,9 @@
 // identify the node to GroveStreams and also specify the timing and
 // frequency of data transmission.
 //
-// The XBee NI must be set as follows. No validity checking is done;
-// failure to follow the format exactly will result in undefined behaviour.
+// The XBee NI must be set as follows. A Node ID that doesn't follow the
+// format, or has a field out of range, is rejected (see parseErr) and the
+// node keeps its previous component ID and schedule.
 //
 // Node Identifier Format: CompID_ssmmnnww
 //
@@ -43,14 +44,335 @@
 #include <Streaming.h>                                      //http://arduiniana.org/libraries/streaming/
 #include <XBee.h>                                           //http://github.com/andrewrapp/xbee-arduino
 
+//Diagnostic messages. GSXBEE_LOG_LEVEL selects which messages are compiled in:
+//GSXBEE_LOG_NONE, GSXBEE_LOG_ERROR (failures only), or GSXBEE_LOG_INFO (failures
+//and traffic, the default). Messages are printed to GSXBEE_LOG (default Serial),
+//or to the Print (a gsXBeeT's LogSink) set for each instance with setLog().
+//Define GSXBEE_TRACE to also record each event as a compact binary record in a
+//ring buffer of GSXBEE_TRACE_LEN records in RAM, which can be printed with
+//traceDump(). With GSXBEE_LOG_LEVEL set to GSXBEE_LOG_NONE and GSXBEE_TRACE defined,
+//diagnostics cost a few microseconds per event instead of blocking on the UART.
+//These must be defined where the library is compiled, i.e. in this file or
+//in the build flags, not in the sketch.
+#define GSXBEE_LOG_NONE 0
+#define GSXBEE_LOG_ERROR 1
+#define GSXBEE_LOG_INFO 2
+#ifndef GSXBEE_LOG_LEVEL
+#define GSXBEE_LOG_LEVEL GSXBEE_LOG_INFO
+#endif
+#ifndef GSXBEE_LOG
+#define GSXBEE_LOG Serial
+#endif
+//#define GSXBEE_TRACE
+#ifndef GSXBEE_TRACE_LEN
+#define GSXBEE_TRACE_LEN 16
+#endif
+
 const uint8_t PAYLOAD_LEN(84);                              //maximum payload length for XBee ZB modules is 84 bytes
 const char SOH = 0x01;                                      //start of header
 const char STX = 0x02;                                      //start of text
+const uint8_t AT_TIMEOUT(0xFF);                             //AT command status passed to callbacks when no response arrived
+const uint8_t TX_NO_STATUS(0xFF);                           //delivery status passed to TX callbacks when no TX status arrived
+const uint16_t TX_STATUS_TIMEOUT(10000);                    //milliseconds to wait for a TX status
+const uint16_t TS_ERR_UNKNOWN(0xFFFF);                      //time sync error passed to the precise time sync callback when it can't be estimated
+const uint16_t MSG_TIMEOUT(5000);                           //milliseconds to wait for the next fragment of a message
+const uint8_t XB_CREATE_SOURCE_ROUTE(0x21);                 //API frame types used for many-to-one routing
+const uint8_t XB_ROUTE_RECORD(0xA1);
+const uint8_t XB_MTO_REQUEST(0xA3);
+
+//Memory profile. By default the tunables below are set to the minimum for
+//a sensor node, so that the library fits MCUs with little SRAM such as the
+//ATmega328, and batching and fragmented messages share one buffer
+//(fragBegin() sends any batched values first, and batchAdd() fails while a
+//fragmented message is being sent). Defining GSXBEE_FULL sets the defaults
+//for a coordinator or router on an MCU with more SRAM: deeper queues,
+//reassembly of fragmented messages, source routes, retries, the send queue,
+//and link statistics. Either way, tunables defined in the build flags
+//override the profile's defaults. The gsXBeeMemory example sketch reports
+//the object size and stack use.
+//#define GSXBEE_FULL
+#ifdef GSXBEE_FULL
+#ifndef GSXBEE_AT_SLOTS
+#define GSXBEE_AT_SLOTS 4
+#endif
+#ifndef GSXBEE_TX_SLOTS
+#define GSXBEE_TX_SLOTS 4
+#endif
+#ifndef GSXBEE_RX_SLOTS
+#define GSXBEE_RX_SLOTS 2
+#endif
+#ifndef GSXBEE_MSG_SLOTS
+#define GSXBEE_MSG_SLOTS 1
+#endif
+#ifndef GSXBEE_TS_SLOTS
+#define GSXBEE_TS_SLOTS 4
+#endif
+#ifndef GSXBEE_ADDR_SLOTS
+#define GSXBEE_ADDR_SLOTS 4
+#endif
+#ifndef GSXBEE_ROUTE_SLOTS
+#define GSXBEE_ROUTE_SLOTS 4
+#endif
+#ifndef GSXBEE_OUT_SLOTS
+#define GSXBEE_OUT_SLOTS 2
+#endif
+#ifndef GSXBEE_SEND_SLOTS
+#define GSXBEE_SEND_SLOTS 2
+#endif
+#ifndef GSXBEE_STATS
+#define GSXBEE_STATS 1
+#endif
+#ifndef GSXBEE_AT_HANDLERS
+#define GSXBEE_AT_HANDLERS 4
+#endif
+#endif
+
+#ifndef GSXBEE_AT_SLOTS
+#define GSXBEE_AT_SLOTS 2                                   //maximum number of AT commands awaiting a response
+#endif
+#ifndef GSXBEE_TX_SLOTS
+#define GSXBEE_TX_SLOTS 2                                   //maximum number of transmissions awaiting a TX status
+#endif
+#ifndef GSXBEE_RX_SLOTS
+#define GSXBEE_RX_SLOTS 1                                   //number of received data packets that can be queued
+#endif
+#ifndef GSXBEE_MSG_SLOTS
+#define GSXBEE_MSG_SLOTS 0                                  //number of fragmented messages that can be reassembled at once, 0 to not receive them
+#endif
+#ifndef GSXBEE_MSG_LEN
+#define GSXBEE_MSG_LEN 256                                  //longest fragmented message that can be received
+#endif
+#ifndef GSXBEE_TS_SLOTS
+#define GSXBEE_TS_SLOTS 1                                   //number of time sync requests a time server can queue
+#endif
+#ifndef GSXBEE_ADDR_SLOTS
+#define GSXBEE_ADDR_SLOTS 1                                 //number of nodes whose addresses are cached
+#endif
+#ifndef GSXBEE_ROUTE_SLOTS
+#define GSXBEE_ROUTE_SLOTS 0                                //number of source routes kept from route records, 0 for none
+#endif
+#ifndef GSXBEE_ROUTE_HOPS
+#define GSXBEE_ROUTE_HOPS 6                                 //most intermediate hops in a source route
+#endif
+#ifndef GSXBEE_OUT_SLOTS
+#define GSXBEE_OUT_SLOTS 0                                  //number of outbound data packets kept for retry, 0 for none
+#endif
+#ifndef GSXBEE_SEND_SLOTS
+#define GSXBEE_SEND_SLOTS 0                                 //number of outgoing frames that can wait for room at the XBee, 0 to send each at once
+#endif
+#ifndef GSXBEE_FRAME_SLOTS
+#define GSXBEE_FRAME_SLOTS 0                                //number of received API frames rxByte() can queue, 0 for none
+#endif
+#ifndef GSXBEE_STATS
+#define GSXBEE_STATS 0                                      //1 to keep the link statistics
+#endif
+#ifndef GSXBEE_AT_HANDLERS
+#define GSXBEE_AT_HANDLERS 1                                //maximum number of AT command response handlers
+#endif
 enum xbeeReadStatus_t
 {
     NO_TRAFFIC, READ_TIMEOUT, TX_ACK, TX_FAIL, COMMAND_RESPONSE, AI_CMD_RESPONSE, DA_CMD_RESPONSE,
     FR_CMD_RESPONSE, NI_CMD_RESPONSE, VR_CMD_RESPONSE, MODEM_STATUS, RX_NO_ACK, RX_DATA, RX_TIMESYNC,
-    RX_ERROR, RX_UNKNOWN, UNKNOWN_FRAME
+    RX_ERROR, RX_UNKNOWN, UNKNOWN_FRAME,
+    DB_CMD_RESPONSE, RX_FRAGMENT, RX_MESSAGE, ROUTE_RECORD, MTO_REQUEST     //new values are added at the end
+};
+const uint8_t N_READ_STATUS(MTO_REQUEST + 1);               //number of xbeeReadStatus_t values
+
+//link and throughput statistics, maintained by read() and the send functions.
+//counters are 16 bits and wrap; call resetStats() after reporting them.
+//histogram bucket edges are given with each histogram.
+const uint8_t STATS_TX_FAIL(8);
+const uint8_t STATS_RETRIES(4);
+const uint8_t STATS_DSCY(5);
+const uint8_t STATS_LATENCY(8);
+const uint8_t STATS_RSS(6);
+struct xbeeStats_t
+{
+    uint32_t msSince;                       //millis() when the statistics were last reset
+    uint16_t readStatus[N_READ_STATUS];     //frames processed by read(), by xbeeReadStatus_t (NO_TRAFFIC is not counted)
+    uint16_t txSent;                        //transmissions
+    uint16_t txAck;                         //transmissions delivered
+    uint16_t txFail[STATS_TX_FAIL];         //transmissions not delivered, by delivery status: CCA failure, network ACK failure,
+                                            //  not joined, address not found, route not found, payload too large,
+                                            //  no TX status (TX_NO_STATUS), other
+    uint16_t txRetries[STATS_RETRIES];      //transmissions by retry count: 0, 1, 2, 3+
+    uint16_t txDscy[STATS_DSCY];            //transmissions by discovery status: none, address, route, address and route, other
+    uint16_t txLatency[STATS_LATENCY];      //transmission to TX status, ms: <32, <64, <128, <256, <512, <1024, <2048, 2048+
+    uint32_t txLatencySum;                  //total of the latencies counted in txLatency, ms
+    uint16_t rss[STATS_RSS];                //received signal strength, dBm: > -50, > -60, > -70, > -80, > -90, -90 or less
+    int32_t rssSum;                         //total of the values counted in rss, dBm
+    uint16_t rxOverruns;                    //data packets dropped because the receive queue was full
+    uint16_t mdmHwReset;                    //modem status: hardware reset
+    uint16_t mdmAssoc;                      //modem status: associated
+    uint16_t mdmDisassoc;                   //modem status: disassociated
+    uint16_t mdmOther;                      //modem status: other
+    uint16_t atFail;                        //AT commands answered with an error status
+    uint16_t atTimeout;                     //AT commands not answered
+    uint16_t routeRecords;                  //route records received
+    uint16_t sourceRoutes;                  //source routes given to the XBee
+    uint16_t outRetries;                    //data packets retransmitted from the outbound queue
+    uint16_t outStored;                     //data packets written to the backlog store
+    uint16_t outDropped;                    //data packets given up on, out of retries or store space
+};
+
+//trace events, one for each diagnostic message
+enum xbeeTraceEvent_t
+{
+    TR_NO_RESPONSE, TR_ASSOC_FAIL, TR_VR_FAIL, TR_HW_RESET, TR_ASSOC, TR_DISASSOC, TR_MODEM_STATUS,
+    TR_RX_ACK, TR_RX, TR_RX_NO_ACK, TR_RX_UNKNOWN_TYPE, TR_RX_MALFORMED, TR_RX_QUEUE_FULL, TR_UNEXP_FRAME,
+    TR_CMD, TR_CMD_FAIL, TR_CMD_UNKNOWN, TR_CMD_TIMEOUT, TR_RSS_LEN_ERR,
+    TR_TX, TR_TX_OK, TR_TX_FAIL, TR_TX_NO_STATUS, TR_TIME_SYNC_REQ, TR_TIME_SYNC, TR_RESET,
+    TR_MSG, TR_MSG_DROPPED, TR_ROUTE_RECORD, TR_SOURCE_ROUTE, TR_REASSOC,
+    TR_OUT_RETRY, TR_OUT_STORE, TR_OUT_DROP, TR_TX_WAIT
+};
+
+//a trace record. the meaning of a, b and c depends on the event, see traceDump().
+struct xbeeTrace_t
+{
+    uint32_t ms;                //time of the event, from millis()
+    uint8_t event;              //xbeeTraceEvent_t
+    uint8_t a;
+    uint8_t b;
+    uint16_t c;
+};
+
+//when to query the received signal strength (DB command) for incoming data packets
+enum rssPolicy_t
+{
+    RSS_OFF, RSS_EVERY, RSS_SAMPLED
+};
+
+//initialization state machine states, as returned by poll()
+enum xbeeInitState_t
+{
+    INIT_IDLE, INIT_POR_WAIT, INIT_WAIT_FR, INIT_WAIT_RESTART, INIT_WAIT_AI, INIT_WAIT_ASSOC,
+    INIT_WAIT_NI_VR, INIT_COMPLETE, INIT_FAIL
+};
+
+//results of parsing a received packet's header or the Node ID, see parseErr
+enum xbeeParseErr_t
+{
+    PARSE_OK, PARSE_TOO_SHORT, PARSE_NO_SOH, PARSE_NO_STX, PARSE_COMPID_LEN, PARSE_TOO_LONG,
+    PARSE_NI_FORMAT, PARSE_NI_RANGE
+};
+
+//reassociation recovery states, as returned by linkState()
+enum xbeeLinkState_t
+{
+    LINK_UP, LINK_DOWN
+};
+
+//transmit priority classes, most urgent first: time sync packets (S), AT
+//commands, data packets (D, B, H, M), and message fragments (F). see txWindow.
+enum xbeePriority_t
+{
+    PRI_TIMESYNC, PRI_CONTROL, PRI_DATA, PRI_BULK
+};
+
+//an AT command response, as passed to AT command callbacks and handlers
+struct atResponse_t
+{
+    char cmd[3];                //the command, two characters with zero terminator
+    uint8_t frameID;            //frame ID of the command
+    uint8_t status;             //status from the XBee (0 = OK), or AT_TIMEOUT
+    uint8_t* value;             //returned value (valid only during the callback), NULL if none
+    uint8_t valueLen;           //length of the returned value
+};
+typedef void (*atCallback_t)(atResponse_t &resp);
+
+//a received data packet, as held in the receive queue
+struct rxPacket_t
+{
+    char packetType;            //D = data packet, M = mail/mqtt packet, H = link statistics (see sendStats())
+    char compID[9];             //sender's component ID
+    XBeeAddress64 addr;         //sender's 64-bit address
+    uint16_t addr16;            //sender's 16-bit network address
+    int8_t rss;                 //received signal strength, dBm, zero if not (yet) known
+    uint8_t rssFrameID;         //frame ID of the DB command that will supply rss, zero if none
+    uint32_t ms;                //arrival time, from millis()
+    uint8_t len;                //length of data, excluding the zero terminator
+    char data[PAYLOAD_LEN - 3]; //packet data, zero terminated
+};
+
+//a message reassembled from fragments (F packets), see fragBegin()
+struct rxMessage_t
+{
+    char packetType;            //packet type given to fragBegin() by the sender
+    char compID[9];             //sender's component ID
+    XBeeAddress64 addr;         //sender's 64-bit address
+    uint8_t msgID;              //message ID assigned by the sender
+    uint32_t ms;                //arrival time of the last fragment, from millis()
+    uint16_t len;               //length of data, excluding the zero terminator
+    char data[GSXBEE_MSG_LEN + 1];  //message data, zero terminated
+};
+
+//the outcome of a transmission, as passed to the TX callback function
+struct txResult_t
+{
+    uint8_t frameID;            //frame ID returned by the send function
+    char packetType;            //type of packet that was sent
+    XBeeAddress64 dest;         //destination address
+    uint8_t delyStatus;         //delivery status from the XBee (0 = success), or TX_NO_STATUS
+    uint8_t dscyStatus;         //discovery status from the XBee
+    uint8_t retries;            //transmit retry count from the XBee
+    uint16_t addr16;            //destination's 16-bit network address as reported in the TX status
+    uint16_t latency;           //milliseconds from transmission to TX status
+};
+typedef void (*txCallback_t)(txResult_t &result);
+
+//precise time sync callback: the current time as utc seconds plus milliseconds,
+//and the estimated error in milliseconds (TS_ERR_UNKNOWN if it can't be estimated)
+typedef void (*syncCallback_t)(uint32_t utc, uint16_t ms, uint16_t errMs);
+
+//transmission schedule callback, called with the transmit time (utc) of the slot
+typedef void (*scheduleCallback_t)(uint32_t txTime);
+
+//Create Source Route API frame (0x21), gives the XBee the route to a remote node.
+//hops are the 16-bit addresses of the intermediate nodes, in the order they
+//appear in a Route Record Indicator (0xA1) frame from the remote node.
+class CreateSourceRouteRequest : public XBeeRequest
+{
+public:
+    CreateSourceRouteRequest(XBeeAddress64 &addr64, uint16_t addr16, uint8_t nHops, uint16_t* hops);
+    uint8_t getFrameData(uint8_t pos);
+    uint8_t getFrameDataLength();
+
+private:
+    XBeeAddress64 _addr64;
+    uint16_t _addr16;
+    uint8_t _nHops;
+    uint16_t* _hops;
+};
+
+//storage for the outbound queue's backlog, see setStore(). an implementation
+//provides size() bytes of non-volatile memory, addressed from zero.
+class gsXBeeStore
+{
+public:
+    virtual uint16_t size() = 0;
+    virtual void read(uint16_t addr, uint8_t* buf, uint8_t len) = 0;
+    virtual void write(uint16_t addr, const uint8_t* buf, uint8_t len) = 0;
+};
+
+//assembles XBee API frames (API mode 2, escaped) one byte at a time as they
+//are received. put() stores the frame data (after the API identifier) in
+//data, or if data is NULL, checks the frame without storing it.
+class gsXBeeFramer
+{
+public:
+    gsXBeeFramer() : pos(0) {}
+    int8_t put(uint8_t b, uint8_t* data);
+
+    uint8_t apiID;              //the complete frame's API identifier
+    uint8_t dataLen;            //and the length of its frame data
+    uint8_t checksum;
+    uint8_t error;              //XBee error code, when a frame is discarded
+
+private:
+    uint8_t pos;                //position in the frame, zero when waiting for a start byte
+    uint8_t len;                //frame length, from the frame header
+    uint8_t sum;                //checksum so far
+    bool esc;                   //the last byte was an escape
 };
 
 //a union between a 32-bit integer and a 4-byte array
@@ -59,20 +381,82 @@ union charInt_t {
     uint32_t i;
 };
 
-class gsXBee : public XBee
+//the XBee driver, bound at compile time to the class of its serial port and
+//the class its diagnostic messages are printed to. gsXBee (below) is the
+//driver for any Stream, logging to a Print. a port class only needs
+//available(), read() and write(uint8_t); if they are not virtual, the compiler
+//can inline the byte I/O, which otherwise costs a virtual call per byte.
+//LogSink is Print, or any class with the Streaming << operators, e.g.
+//gsXBeeNoLog to compile an instance's messages out; an instance with a
+//LogSink other than Print prints nothing until setLog() is called.
+//Example:
+//  gsXBeeT<MyUart, gsXBeeNoLog> xb;
+//  xb.begin(uart);
+template <class SerialPort, class LogSink = Print>
+class gsXBeeT : public XBee
 {
 public:
-    gsXBee();
-    bool begin(Stream &serial, bool resetXBee = true);
+    gsXBeeT();
+    bool begin(SerialPort &serial, bool resetXBee = true);
+    void beginAsync(SerialPort &serial, bool resetXBee = true);
+    void setSerial(SerialPort &serial);
+    xbeeInitState_t poll();
+    xbeeLinkState_t linkState();
     xbeeReadStatus_t waitFor(xbeeReadStatus_t stat, uint32_t timeout);
     xbeeReadStatus_t read();
-    void sendCommand(uint8_t* cmd);
-    void sendData(char* data, char packetType='D');
-    void sendData(char packetType, uint8_t* data, uint8_t len);
-    void requestTimeSync(uint32_t utc);
-    void sendTimeSync(uint32_t utc);
+    uint8_t sendCommand(uint8_t* cmd, atCallback_t callback = NULL, uint16_t timeout = 1000,
+        uint8_t* value = NULL, uint8_t valueLen = 0);
+    bool atPending(uint8_t frameID);
+    bool onCommand(const char* cmd, atCallback_t handler);
+    uint8_t sendData(char* data, char packetType='D');
+    uint8_t sendData(char packetType, uint8_t* data, uint8_t len);
+    char* beginPacket(char packetType = 'D');
+    uint8_t packetRoom();
+    uint8_t endPacket(uint8_t dataLen);
+    bool batchAdd(const char* streamID, const char* value);
+    bool batchAdd(const char* streamID, int value);
+    bool batchAdd(const char* streamID, long value);
+    bool batchAdd(const char* streamID, double value, uint8_t decimals = 2);
+    uint8_t batchFlush();
+    void setStreamDict(const char* const* streamIDs, uint8_t n);
+    uint8_t batchLength();
+    uint8_t sendTo(const char* destCompID, char* data, char packetType = 'D');
+    bool lookup(const char* compID, XBeeAddress64 &addr);
+    uint8_t setManyToOne(uint8_t interval);
+    int8_t routeHops(XBeeAddress64 &addr);
+    uint8_t fragBegin(char packetType = 'D');
+    uint16_t fragWrite(const uint8_t* data, uint16_t len);
+    uint16_t fragWrite(const char* data);
+    uint8_t fragEnd();
+    rxMessage_t* getMessage();
+    uint8_t requestTimeSync(uint32_t utc);
+    uint8_t sendTimeSync(uint32_t utc, uint16_t ms = 0);
+    uint8_t tsPending();
+    void setTxCallback(txCallback_t fcn);
+    uint8_t txPending();
+    void setStore(gsXBeeStore* store);
+    uint16_t outPending();
     void setSyncCallback( void (*fcn)(uint32_t) );          //set the time sync callback function
+    void setSyncCallback(syncCallback_t fcn);               //set the precise time sync callback function
+    uint32_t nextTransmit(uint32_t utc);
+    uint32_t nextWarmup(uint32_t utc);
+    void setScheduleCallbacks(scheduleCallback_t warmup, scheduleCallback_t transmit);
+    void schedule(uint32_t utc);
+    static uint32_t nextSlot(uint32_t utc, uint8_t sec, uint8_t interval, uint8_t offset);
+    static bool slotsCollide(uint8_t secA, uint8_t intervalA, uint8_t offsetA, uint8_t secB, uint8_t intervalB, uint8_t offsetB);
+    uint8_t available();
+    rxPacket_t* peek();
+    void pop();
+    void getStats(xbeeStats_t &s);
+    void resetStats();
+    uint8_t sendStats();
     void mcuReset(uint32_t dly = 0 );
+    void traceDump(Print &out = GSXBEE_LOG);
+    void setLog(LogSink* out);
+#if GSXBEE_FRAME_SLOTS > 0
+    void rxByte(uint8_t b);
+    uint8_t rxPump();
+#endif
 
     char compID[10];            //our component ID
     uint8_t txSec;              //transmit on this second, 0 <= txSec < 60
@@ -80,33 +464,334 @@ public:
     uint8_t txOffset;           //minute offset to transmit, 0 <= txOffset < txInterval
     uint8_t txWarmup;           //seconds to wake before transmission time, to allow sensors to produce data, etc.
     uint8_t assocStatus;        //association status as returned in response from the AI command
-    int8_t rss;                 //received signal strength, dBm
-    bool disassocReset;         //flag to reset MCU when XBee disassociation occurs
+    int8_t rss;                 //received signal strength, dBm. updated when the DB response arrives, after read() returns RX_DATA
+    rssPolicy_t rssPolicy;      //query RSS for every data packet (default), every rssSampleN'th packet, or not at all
+    uint8_t rssSampleN;         //sampling interval for RSS_SAMPLED
+    bool disassocReset;         //flag to reset MCU when the XBee does not reassociate within reassocTimeout
+    uint32_t reassocTimeout;    //milliseconds to wait for reassociation before resetting the MCU, zero to wait indefinitely
     bool isTimeServer;          //if server, responds to requests for current time; else uses callback function to set time. 
+    bool tsBroadcast;           //if server, answer two or more queued time sync requests with one broadcast
+    uint16_t tsMaxDelay;        //if not server, ignore time sync replies whose round trip delay exceeds this, ms
     char packetType;            //D = data packet, S = time sync packet
     uint32_t msTX;              //last XBee transmission time from millis()
     XBeeAddress64 sendingAddr;  //address of node that sent packet
+    xbeeParseErr_t parseErr;    //result of parsing the last packet header or Node ID received
     XBeeAddress64 destAddr;     //destination address
     uint16_t firmwareVersion;
     char atCmdRecd[4];          //the AT command responded to in an AT Command Response packet (two chars with zero terminator)
     char sendingCompID[10];     //sender's component ID from received packet
     char payload[PAYLOAD_LEN];  //XBee payload
+    uint16_t rxOverruns;        //data packets dropped because the receive queue was full
+    uint32_t batchTimeout;      //milliseconds after the first batchAdd() to send the batch, zero to wait for batchFlush() or a full batch
+    uint8_t retryLimit;         //transmissions of a data packet before it is stored or dropped, 1 for no retries
+    uint16_t outPace;           //milliseconds between retransmissions from the outbound queue and backlog
+    uint8_t txWindow;           //frames outstanding at the XBee (awaiting a TX status or AT response) before others wait, 0 for no limit
+#if GSXBEE_FRAME_SLOTS > 0
+    volatile uint16_t frameOverruns;    //API frames dropped because the frame queue was full
+    volatile uint16_t frameErrors;      //API frames discarded by rxByte() for bad checksums, etc.
+#endif
 
 private:
-    bool parsePacket();
+    struct tsStamp_t                        //times to fill in a time sync packet as it is transmitted, see tsStamp()
+    {
+        uint8_t offset;                     //of the time fields in the payload
+        bool reply;                         //a reply, else a request
+        bool precise;                       //a reply to a request that included origin
+        uint32_t utc;                       //reply: the time at msRef
+        uint32_t msRef;                     //from millis()
+        uint32_t msRX;                      //precise reply: when the request arrived, from millis()
+    };
+#if GSXBEE_SEND_SLOTS > 0
+    struct sendSlot_t                       //a frame waiting for room at the XBee
+    {
+        uint8_t frameID;
+        uint8_t priority;                   //xbeePriority_t
+        char packetType;                    //zero for an AT command
+        uint8_t len;                        //of data
+        uint8_t outSlot;                    //outbound queue slot holding the packet, OUT_NONE if not queued
+        uint32_t msQueued;                  //from millis()
+        XBeeAddress64 dest;
+        uint8_t data[PAYLOAD_LEN];          //the payload, or the AT command followed by its value
+    };
+#endif
+
+    void readFrame();
+    void writeFrame(XBeeRequest &request);
+    void writeByte(uint8_t b);
+    bool frameByte(uint8_t b);
+    void frameClear();
+    void frameSet(uint8_t apiID, uint8_t* data, uint8_t len, uint8_t checksum);
+    xbeeReadStatus_t readXBee();
+    xbeeReadStatus_t atCommandResponse();
+    xbeeReadStatus_t txStatusResponse(uint32_t ms);
+    uint8_t sendPayload(XBeeAddress64 &dest, char type, uint8_t len, tsStamp_t* stamp = NULL);
+    void txFrame(uint8_t frameID, XBeeAddress64 &dest, char type, uint8_t* data, uint8_t len, uint8_t outSlot, tsStamp_t* stamp = NULL);
+    void atFrame(uint8_t frameID, uint8_t* cmd, uint8_t* value, uint8_t valueLen);
+    void tsStamp(uint8_t* data, tsStamp_t &ts);
+#if GSXBEE_SEND_SLOTS > 0
+    bool txNow(uint8_t priority);
+    uint8_t txOutstanding();
+    sendSlot_t* sendQueue(uint8_t frameID, uint8_t priority, char type, uint8_t len);
+    void sendRemove(uint8_t i);
+    void txDispatch();
+    void txSendNext();
+#endif
+    uint8_t header(char type);
+    void cacheHeader();
+    uint8_t sendPacket(char type, uint8_t len);
+    void txComplete(uint8_t slot, txResult_t &result);
+    void txExpire(uint32_t ms);
+    uint8_t outTrack(XBeeAddress64 &dest, char type, uint8_t len);
+    void outResult(uint8_t slot, bool delivered);
+#if GSXBEE_OUT_SLOTS > 0
+    void outService(uint32_t ms);
+    void outStore(uint8_t slot);
+    bool outLoad(uint8_t slot);
+    void storeIO(uint16_t pos, uint8_t* buf, uint8_t len, bool write);
+    void storeHeader(bool write);
+    uint8_t storeCheck(uint8_t* h);
+#endif
+    void atExpire(uint32_t ms);
+    void decodeAI(atResponse_t &resp);
+    void decodeNI(atResponse_t &resp);
+    void decodeVR(atResponse_t &resp);
+    void initAdvance(xbeeReadStatus_t stat);
+    void linkAdvance();
+    uint16_t jitter(uint16_t n);
+    xbeeParseErr_t parsePacket();
     void buildDataPayload();
-    void getRSS();
-    void parseNodeID(char* nodeID);
+    void rxEnqueue(uint32_t ms);
+    uint8_t requestRSS();
+    bool batchAddFixed(const char* streamID, int32_t scaled, uint8_t decimals);
+    static uint8_t formatFixed(char* buf, int32_t scaled, uint8_t decimals);
+    bool expandBinary();
+    uint8_t fragSend(bool last);
+    xbeeReadStatus_t fragReceive(uint32_t ms);
+    void msgExpire(uint32_t ms);
+    void decodeDB(atResponse_t &resp);
+    xbeeParseErr_t parseNodeID(const char* nodeID, uint8_t len);
+    xbeeReadStatus_t routeRecord();
+    void sourceRoute(XBeeAddress64 &dest, uint16_t &addr16);
+    void routeForget(XBeeAddress64 &dest);
+    void addrLearn(const char* id, XBeeAddress64 &addr, uint16_t addr16);
+    uint16_t addrFind16(XBeeAddress64 &addr);
+    void addrUpdate16(XBeeAddress64 &addr, uint16_t addr16);
+    void statsTx(txResult_t &result);
+    void statsRSS(int8_t dBm);
+    xbeeReadStatus_t timeSyncReceived();
+    uint8_t sendTimeSyncTo(XBeeAddress64 &dest, uint32_t utc, uint32_t msRef, uint8_t slot);
+    void trace(uint8_t event, uint8_t a = 0, uint8_t b = 0, uint16_t c = 0);
     void copyToBuffer(char* dest, uint32_t source);
     uint32_t getFromBuffer(char* source);
+    static Print* logDefault(Print*) { return &GSXBEE_LOG; }           //initial logOut, see gsXBeeT
+    template <class T> static T* logDefault(T*) { return NULL; }
 
     void (*timeSyncCallback)(uint32_t);     //user function called to set the time when a sync packet is received (if not a time server)
-    char tsCompID[10];                      //time sync requestor's component ID
-    ZBTxStatusResponse zbStat;
-    AtCommandResponse atResp;
-    ModemStatusResponse zbMSR;
+    syncCallback_t preciseSyncCallback;     //same, with milliseconds and estimated error
+    scheduleCallback_t warmupCallback;      //user functions called by schedule()
+    scheduleCallback_t transmitCallback;
+    uint32_t schedTX;                       //next transmit time tracked by schedule(), zero if not yet known
+    bool schedWarmedUp;                     //the warmup callback has been called for schedTX
+    struct tsSlot_t                         //a queued time sync request
+    {
+        XBeeAddress64 addr;                 //requestor's address
+        char compID[9];                     //requestor's component ID
+        uint32_t origin;                    //requestor's millis() when it sent the request
+        uint32_t msRX;                      //our millis() when the request arrived
+        bool precise;                       //the request included origin
+    };
+    tsSlot_t tsQueue[GSXBEE_TS_SLOTS];
+    uint8_t tsCount;                        //number of requests in tsQueue
+    bool tsOverflow;                        //requests were dropped because tsQueue was full
+    struct atSlot_t                         //an AT command awaiting its response
+    {
+        uint8_t frameID;                    //zero if the slot is free
+        char cmd[2];
+        uint16_t timeout;                   //milliseconds
+        uint32_t msSent;                    //from millis()
+        atCallback_t callback;
+    };
+    struct atHandler_t                      //user-registered AT command response handler
+    {
+        char cmd[2];
+        atCallback_t handler;
+    };
+    atSlot_t atSlots[GSXBEE_AT_SLOTS];
+    uint8_t atInFlight;                     //number of atSlots in use
+    uint8_t rssCount;                       //data packets received since the last RSS query
+    struct txSlot_t                         //a transmission awaiting its TX status
+    {
+        uint8_t frameID;                    //zero if the slot is free
+        char packetType;
+        XBeeAddress64 dest;
+        uint32_t msTX;                      //from millis()
+        uint8_t outSlot;                    //outbound queue slot holding the packet, OUT_NONE if not queued
+    };
+    txSlot_t txSlots[GSXBEE_TX_SLOTS];
+    uint8_t txInFlight;                     //number of txSlots in use
+    txCallback_t txCallback;                //user function called with the outcome of each transmission
+    char txHeader[12];                      //cached packet header: SOH, packet type, component ID, STX
+    uint8_t txHeaderLen;                    //length of txHeader, zero if not built
+    uint8_t pktHeaderLen;                   //header length of the packet started by beginPacket(), zero if none
+#if GSXBEE_SEND_SLOTS > 0
+    sendSlot_t sendSlots[GSXBEE_SEND_SLOTS];    //frames waiting for room at the XBee, in the order queued
+    uint8_t sendCount;                      //number of sendSlots in use
+#endif
+#if GSXBEE_OUT_SLOTS > 0
+    struct outSlot_t                        //a data packet kept until it is delivered
+    {
+        uint8_t state;                      //OUT_FREE, OUT_IN_FLIGHT, OUT_WAITING
+        uint8_t tries;                      //transmissions so far
+        char packetType;
+        uint8_t len;
+        uint32_t retryAt;                   //when to retransmit, from millis()
+        XBeeAddress64 dest;
+        char data[PAYLOAD_LEN];             //the payload, header included
+    };
+    enum { OUT_FREE, OUT_IN_FLIGHT, OUT_WAITING };
+    outSlot_t outSlots[GSXBEE_OUT_SLOTS];
+    uint8_t outCount;                       //number of outSlots in use
+    uint8_t outSending;                     //slot being retransmitted, OUT_NONE if none
+    uint32_t outLastSend;                   //time of the last retransmission, from millis()
+    uint16_t outWait;                       //milliseconds from outLastSend to the next retransmission
+    gsXBeeStore* store;                     //backlog storage, NULL if none
+    uint16_t storeHead;                     //offset in the store's data area of the next record to write
+    uint16_t storeTail;                     //offset of the oldest record
+    uint16_t storeCount;                    //number of records in the store
+    uint8_t storeSeq;                       //sequence number of the last position record written
+#endif
+#ifndef GSXBEE_FULL
+    union
+    {
+        char batchBuf[PAYLOAD_LEN];         //stream/value pairs waiting to be sent, zero terminated
+        uint8_t fragBuf[PAYLOAD_LEN];       //the F packet being built: message ID, sequence number, packet type, data
+    };
+#else
+    char batchBuf[PAYLOAD_LEN];             //stream/value pairs waiting to be sent, zero terminated
+    uint8_t fragBuf[PAYLOAD_LEN];           //the F packet being built: message ID, sequence number, packet type, data
+#endif
+    uint8_t batchLen;
+    uint32_t batchStart;                    //time of the first batchAdd() since the last flush, from millis()
+    uint8_t batchTextLen;                   //length of the batch when expanded to text (B packets)
+    const char* const* streamDict;          //stream IDs for B packets, NULL for D packets
+    uint8_t streamDictLen;
+    uint8_t fragLen;                        //bytes in fragBuf, zero if no message is being sent
+    uint8_t fragMsgID;                      //ID of the last message sent
+#if GSXBEE_MSG_SLOTS > 0
+    struct msgSlot_t                        //a message being reassembled
+    {
+        uint8_t state;                      //MSG_FREE, MSG_ASSEMBLING, MSG_COMPLETE
+        uint8_t nextSeq;                    //sequence number of the next fragment expected
+        rxMessage_t msg;
+    };
+    enum { MSG_FREE, MSG_ASSEMBLING, MSG_COMPLETE };
+    msgSlot_t msgSlots[GSXBEE_MSG_SLOTS];
+    uint8_t msgAssembling;                  //number of msgSlots in the MSG_ASSEMBLING state
+    msgSlot_t* msgComplete;                 //message returned by getMessage(), freed by the next read()
+#endif
+    struct addrSlot_t                       //a cached node address
+    {
+        char compID[9];                     //empty if the slot is free
+        XBeeAddress64 addr;
+        uint16_t addr16;                    //0xFFFE if not known
+        uint16_t lastUsed;                  //value of addrClock when last used
+    };
+    addrSlot_t addrCache[GSXBEE_ADDR_SLOTS];
+    uint16_t addrClock;                     //counts cache uses, for least recently used replacement
+#if GSXBEE_ROUTE_SLOTS > 0
+    struct routeSlot_t                      //a source route from a route record
+    {
+        XBeeAddress64 addr;                 //remote node's addresses
+        uint16_t addr16;
+        uint8_t nHops;                      //number of intermediate hops, 0xFF if the slot is free
+        uint16_t lastUsed;                  //value of addrClock when last used
+        uint16_t hops[GSXBEE_ROUTE_HOPS];
+    };
+    routeSlot_t routes[GSXBEE_ROUTE_SLOTS];
+#endif
+    rxPacket_t rxQueue[GSXBEE_RX_SLOTS];    //received data packets, oldest at rxHead
+    uint8_t rxHead;
+    uint8_t rxCount;
+    bool rxQueueUsed;                       //available(), peek() or pop() has been called, else read() empties the queue
+    uint8_t rxDataLen;                      //length of the data in payload from the last packet parsed
+    atHandler_t atHandlers[GSXBEE_AT_HANDLERS];
+    xbeeInitState_t initState;              //initialization state machine
+    uint32_t initTimer;                     //start time for the current initialization state, from millis()
+    bool initResetXBee;                     //do a firmware reset on the XBee during initialization
+    bool initGotNI;                         //NI response received during initialization
+    bool initGotVR;                         //VR response received during initialization
+    xbeeLinkState_t linkStatus;             //reassociation recovery state machine
+    uint32_t linkDownSince;                 //when the XBee disassociated, from millis()
+    uint32_t linkTimer;                     //when the last AI query was sent, from millis()
+    uint16_t linkWait;                      //milliseconds from linkTimer to the next AI query
+    uint16_t linkBackoff;                   //current AI query interval, without jitter
+#if GSXBEE_STATS
+    xbeeStats_t stats;
+#endif
+#ifdef GSXBEE_TRACE
+    xbeeTrace_t traceBuf[GSXBEE_TRACE_LEN]; //trace records, the next one is written at traceHead
+    uint8_t traceHead;
+    uint8_t traceCount;
+#endif
     ZBRxResponse zbRX;
-    ZBTxRequest zbTX;
+    LogSink* logOut;                        //diagnostic messages are printed here, NULL for none
+    SerialPort* port;                       //the XBee's serial port
+    gsXBeeFramer framer;                    //assembles frames for frameByte() and rxByte()
+#if GSXBEE_FRAME_SLOTS > 0
+    struct frameSlot_t                      //an API frame queued by rxByte()
+    {
+        uint8_t apiID;
+        uint8_t len;                        //of data
+        uint8_t checksum;
+        uint8_t data[MAX_FRAME_DATA_SIZE];
+    };
+    frameSlot_t frameSlots[GSXBEE_FRAME_SLOTS];
+    uint8_t frameTail;                      //rxByte() assembles the next frame here
+    uint8_t frameHead;                      //oldest queued frame
+    volatile uint8_t frameIn;               //frames queued, counted by rxByte(), modulo 256
+    volatile uint8_t frameOut;              //frames taken from the queue, counted by read(), modulo 256
+    bool frameFull;                         //the queue was full when the frame being assembled started
+    bool frameTaken;                        //read() is dispatching the frame at frameHead
+    volatile bool rxPumping;                //rxPump() is running
+#endif
+};
+
+typedef gsXBeeT<Stream, Print> gsXBee;
+
+//a LogSink for gsXBeeT that discards everything, so that the compiler drops
+//the diagnostic messages of the instances that use it
+class gsXBeeNoLog
+{
+public:
+    template <class T> gsXBeeNoLog &operator<<(const T&) { return *this; }
+};
+
+//formats a packet in place in a gsXBee's payload, with print() or the
+//Streaming << operator, and sends it with send(). characters that don't fit
+//are discarded and set overflow(). only one packet can be built at a time,
+//and nothing else may be sent or received until it is sent.
+//gsXBeeWriterT<gsXBeeT<...> > does the same for a gsXBeeT.
+template <class XBeeType>
+class gsXBeeWriterT : public Print
+{
+public:
+    gsXBeeWriterT(XBeeType &xbee, char packetType = 'D');
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buf, size_t n);
+    using Print::write;
+    uint8_t length() { return _len; }
+    bool overflow() { return _overflow; }
+    uint8_t send();
+
+private:
+    XBeeType &_xbee;
+    char* _buf;
+    uint8_t _room;
+    uint8_t _len;
+    bool _overflow;
 };
+typedef gsXBeeWriterT<gsXBee> gsXBeeWriter;
 
+#include "gsXBeeImpl.h"
+extern template class gsXBeeT<Stream, Print>;              //compiled once, in gsXBee.cpp
 #endif
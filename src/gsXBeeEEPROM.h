@@ -0,0 +1,48 @@
+// Arduino XBee Library for GroveStreams Wireless Sensor Network.
+//
+// This work by Jack Christensen is licensed under CC BY-SA 4.0,
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// gsXBeeEEPROM keeps the outbound queue's backlog in a region of the AVR's
+// EEPROM, so packets that could not be delivered survive an MCU reset.
+// It needs an EEPROM library with update(), e.g. the AVR core's; cores
+// whose EEPROM is emulated in flash and needs begin() and commit() (ESP8266,
+// ESP32) are not supported, derive a gsXBeeStore for them instead.
+// Bytes are only written if they change (EEPROM.update). The store's position is written each time a
+// packet is stored or sent from the store, to the next of eight 8-byte
+// records in turn, so each is written once per eight such events; allow
+// for EEPROM wear (about 100,000 writes per byte on the ATmega328) when
+// choosing retryLimit.
+//
+// Example:
+//   gsXBeeEEPROM xbStore(512, 512);     //second half of a 1KB EEPROM
+//   gsXBee xb;
+//   xb.setStore(&xbStore);
+
+#ifndef _GSXBEEEEPROM_H
+#define _GSXBEEEEPROM_H
+#include <gsXBee.h>
+#include <EEPROM.h>
+
+class gsXBeeEEPROM : public gsXBeeStore
+{
+public:
+    gsXBeeEEPROM(uint16_t start, uint16_t len) : start(start), len(len) {}
+
+    uint16_t size() { return len; }
+
+    void read(uint16_t addr, uint8_t* buf, uint8_t n)
+    {
+        for (uint8_t i = 0; i < n; ++i) buf[i] = EEPROM.read(start + addr + i);
+    }
+
+    void write(uint16_t addr, const uint8_t* buf, uint8_t n)
+    {
+        for (uint8_t i = 0; i < n; ++i) EEPROM.update(start + addr + i, buf[i]);
+    }
+
+private:
+    uint16_t start;
+    uint16_t len;
+};
+#endif
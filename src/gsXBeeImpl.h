@@ -0,0 +1,3021 @@
+// Arduino XBee Library for GroveStreams Wireless Sensor Network.
+//
+// This work by Jack Christensen is licensed under CC BY-SA 4.0,
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// The gsXBeeT and gsXBeeWriterT member functions, included by gsXBee.h so that
+// they can be compiled for any serial port class. gsXBee itself (a Stream
+// port and a Print log) is compiled once, in gsXBee.cpp.
+
+#ifndef _GSXBEE_IMPL_H
+#define _GSXBEE_IMPL_H
+#include <gsXBee.h>
+
+//diagnostic messages and trace records, see GSXBEE_LOG_LEVEL and GSXBEE_TRACE in gsXBee.h
+#if GSXBEE_LOG_LEVEL >= GSXBEE_LOG_ERROR
+#define LOG_ERROR(msg) do { if (logOut) *logOut << msg; } while (0)
+#else
+#define LOG_ERROR(msg)
+#endif
+#if GSXBEE_LOG_LEVEL >= GSXBEE_LOG_INFO
+#define LOG_INFO(msg) do { if (logOut) *logOut << msg; } while (0)
+#else
+#define LOG_INFO(msg)
+#endif
+#ifdef GSXBEE_TRACE
+#define TRACE(...) trace(__VA_ARGS__)
+#else
+#define TRACE(...)
+#endif
+
+const uint8_t OUT_NONE(0xFF);                               //no outbound queue slot
+const uint8_t STORE_POS(8);                                 //bytes in each backlog store position record
+const uint8_t STORE_POS_SLOTS(8);                           //position records, written in turn (a power of two)
+const uint8_t STORE_HEADER(STORE_POS * STORE_POS_SLOTS);    //bytes at the start of the backlog store for the position records
+const uint8_t STORE_RECORD(10);                             //bytes before the payload in each backlog record: length, type, address
+const uint8_t STORE_MAGIC(0xA7);                            //seeds the position record checksum
+
+//link statistics, see GSXBEE_STATS in gsXBee.h
+#if GSXBEE_STATS
+#define STAT(x) x
+#else
+#define STAT(x)
+#endif
+
+//constructor. coordinator is default destination.
+template <class SerialPort, class LogSink>
+gsXBeeT<SerialPort, LogSink>::gsXBeeT() : rssPolicy(RSS_EVERY), rssSampleN(10), reassocTimeout(600000), tsBroadcast(false), tsMaxDelay(250), parseErr(PARSE_OK), destAddr(0x0, 0x0), rxOverruns(0), batchTimeout(0), retryLimit(3), outPace(1000), txWindow(2),
+    timeSyncCallback(NULL), preciseSyncCallback(NULL),
+    warmupCallback(NULL), transmitCallback(NULL), schedTX(0), tsCount(0), tsOverflow(false), atInFlight(0), rssCount(0), txInFlight(0), txCallback(NULL), txHeaderLen(0), pktHeaderLen(0),
+    batchLen(0), batchTextLen(0), streamDict(NULL), streamDictLen(0), fragLen(0), fragMsgID(0), addrClock(0), rxHead(0), rxCount(0), rxQueueUsed(false), initState(INIT_IDLE),
+    linkStatus(LINK_UP), logOut(logDefault((LogSink*)NULL)), port(NULL)
+{
+#if GSXBEE_FRAME_SLOTS > 0
+    frameOverruns = frameErrors = 0;
+    frameTail = frameHead = frameIn = frameOut = 0;
+    frameFull = frameTaken = rxPumping = false;
+#endif
+#if GSXBEE_SEND_SLOTS > 0
+    sendCount = 0;
+#endif
+    for (uint8_t i = 0; i < GSXBEE_AT_SLOTS; ++i) atSlots[i].frameID = 0;
+    for (uint8_t i = 0; i < GSXBEE_AT_HANDLERS; ++i) atHandlers[i].handler = NULL;
+    for (uint8_t i = 0; i < GSXBEE_TX_SLOTS; ++i) txSlots[i].frameID = 0;
+    for (uint8_t i = 0; i < GSXBEE_ADDR_SLOTS; ++i) addrCache[i].compID[0] = 0;
+#if GSXBEE_ROUTE_SLOTS > 0
+    for (uint8_t i = 0; i < GSXBEE_ROUTE_SLOTS; ++i) routes[i].nHops = 0xFF;
+#endif
+#if GSXBEE_OUT_SLOTS > 0
+    for (uint8_t i = 0; i < GSXBEE_OUT_SLOTS; ++i) outSlots[i].state = OUT_FREE;
+    outCount = 0;
+    outSending = OUT_NONE;
+    outWait = 0;
+    store = NULL;
+    storeCount = 0;
+    storeSeq = 0;
+#endif
+#if GSXBEE_MSG_SLOTS > 0
+    for (uint8_t i = 0; i < GSXBEE_MSG_SLOTS; ++i) msgSlots[i].state = MSG_FREE;
+    msgAssembling = 0;
+    msgComplete = NULL;
+#endif
+#ifdef GSXBEE_TRACE
+    traceHead = traceCount = 0;
+#endif
+    resetStats();
+}
+
+//optionally reset the XBee. check to see if it's associated, if not, wait.
+//after it's associated, get its Node ID and version information.
+//blocks until initialization completes or fails; see beginAsync() for a
+//non-blocking alternative.
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::begin(SerialPort &serial, bool resetXBee)
+{
+    beginAsync(serial, resetXBee);
+    xbeeInitState_t state;
+    do
+    {
+        state = poll();
+    } while ( state != INIT_COMPLETE && state != INIT_FAIL );
+    return state == INIT_COMPLETE;
+}
+
+//start the initialization sequence without blocking. call poll() (or read())
+//frequently, e.g. from loop(), until it returns INIT_COMPLETE or INIT_FAIL.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::beginAsync(SerialPort &serial, bool resetXBee)
+{
+    port = &serial;
+    initResetXBee = resetXBee;
+    initState = INIT_POR_WAIT;
+    initTimer = millis();
+}
+
+//set the serial port the XBee is connected to, without initializing it
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::setSerial(SerialPort &serial)
+{
+    port = &serial;
+}
+
+//process incoming traffic and advance the initialization state machine.
+//returns the current state; INIT_COMPLETE or INIT_FAIL when finished.
+template <class SerialPort, class LogSink>
+xbeeInitState_t gsXBeeT<SerialPort, LogSink>::poll()
+{
+    read();
+    return initState;
+}
+
+//initialization state machine establishes communication with the XBee and
+//ensures that it is associated. called from read() with the status of the
+//traffic just processed, while initialization is in progress.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::initAdvance(xbeeReadStatus_t stat)
+{
+    const uint32_t POR_DELAY(1000);                         //milliseconds to allow for the XBee POR
+    const uint32_t FR_TIMEOUT(2000);                        //milliseconds to wait for response to FR command
+    const uint32_t RESTART_TIMEOUT(3000);                   //FR takes 2+ seconds, responds with modem status (WDT reset)
+    const uint32_t CMD_TIMEOUT(1000);                       //milliseconds to wait for response to other commands
+    const uint32_t ASSOC_TIMEOUT(60000);                    //milliseconds to wait for XBee to associate
+    uint32_t elapsed = millis() - initTimer;
+
+    switch (initState)
+    {
+    case INIT_POR_WAIT:                                     //allow some time for the XBee POR, handle any incoming traffic
+        if (elapsed >= POR_DELAY)
+        {
+            if (initResetXBee)
+            {
+                uint8_t cmd[] = "FR";                       //firmware reset
+                sendCommand(cmd);
+                initState = INIT_WAIT_FR;
+            }
+            else
+            {
+                uint8_t cmd[] = "AI";                       //get association indicator
+                sendCommand(cmd);
+                initState = INIT_WAIT_AI;
+            }
+            initTimer = millis();
+        }
+        break;
+
+    case INIT_WAIT_FR:
+        if (stat == FR_CMD_RESPONSE)
+        {
+            initState = INIT_WAIT_RESTART;
+            initTimer = millis();
+        }
+        else if (elapsed >= FR_TIMEOUT)
+        {
+            LOG_ERROR(millis() << F("\tThe XBee did not respond\n"));
+            TRACE(TR_NO_RESPONSE, initState);
+            initState = INIT_FAIL;
+        }
+        break;
+
+    case INIT_WAIT_RESTART:
+        if (stat == MODEM_STATUS)
+        {
+            uint8_t cmd[] = "AI";                           //get association indicator
+            sendCommand(cmd);
+            initState = INIT_WAIT_AI;
+            initTimer = millis();
+        }
+        else if (elapsed >= RESTART_TIMEOUT)
+        {
+            LOG_ERROR(millis() << F("\tThe XBee did not respond\n"));
+            TRACE(TR_NO_RESPONSE, initState);
+            initState = INIT_FAIL;
+        }
+        break;
+
+    case INIT_WAIT_AI:                                      //no AI response is not fatal, a modem status may still tell us we're associated
+        if (stat == AI_CMD_RESPONSE || elapsed >= CMD_TIMEOUT)
+        {
+            if (stat != AI_CMD_RESPONSE)
+            {
+                LOG_ERROR(millis() << F("\tThe XBee did not respond\n"));
+                TRACE(TR_NO_RESPONSE, initState);
+            }
+            initState = INIT_WAIT_ASSOC;
+            initTimer = millis();
+        }
+        break;
+
+    case INIT_WAIT_ASSOC:                                   //wait for the XBee to associate
+        if ( assocStatus == 0 )                             //zero means associated
+        {
+            disassocReset = true;                           //any further disassociations are unexpected
+            uint8_t ni[] = "NI";                            //ask for the node ID and firmware version
+            uint8_t vr[] = "VR";                            //back to back, the XBee answers them in order
+            sendCommand(ni);
+            sendCommand(vr);
+            initGotNI = initGotVR = false;
+            initState = INIT_WAIT_NI_VR;
+            initTimer = millis();
+        }
+        else if (elapsed >= ASSOC_TIMEOUT)
+        {
+            initState = INIT_FAIL;
+            LOG_ERROR(millis() << F("\tXBee associate fail\n"));
+            TRACE(TR_ASSOC_FAIL);
+        }
+        break;
+
+    case INIT_WAIT_NI_VR:
+        if (stat == NI_CMD_RESPONSE) initGotNI = true;
+        if (stat == VR_CMD_RESPONSE) initGotVR = true;
+        if (initGotNI && initGotVR)
+        {
+            initState = INIT_COMPLETE;
+        }
+        else if (elapsed >= CMD_TIMEOUT)
+        {
+            if (initGotNI)
+            {
+                LOG_ERROR(millis() << F("\tXBee VR fail\n"));
+                TRACE(TR_VR_FAIL);
+            }
+            else
+            {
+                LOG_ERROR(millis() << F("\tThe XBee did not respond\n"));
+                TRACE(TR_NO_RESPONSE, initState);
+            }
+            initState = INIT_FAIL;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+//read the XBee until a certain type of message is received, or until a certain amount of time has passed.
+template <class SerialPort, class LogSink>
+xbeeReadStatus_t gsXBeeT<SerialPort, LogSink>::waitFor(xbeeReadStatus_t stat, uint32_t timeout)
+{
+    uint32_t msStart = millis();
+    while ( millis() - msStart < timeout )
+    {
+        xbeeReadStatus_t s = read();
+        if ( s == stat ) return s;
+    }
+    return READ_TIMEOUT;
+}
+
+//check the XBee for incoming traffic and process it.
+//also advances the initialization state machine if beginAsync() was called.
+template <class SerialPort, class LogSink>
+xbeeReadStatus_t gsXBeeT<SerialPort, LogSink>::read()
+{
+    if (!rxQueueUsed) rxCount = 0;                          //the sketch reads payload, etc. instead, as before the queue
+    xbeeReadStatus_t stat = readXBee();
+#if GSXBEE_FRAME_SLOTS > 0
+    if (frameTaken)                                         //free the frame's queue slot
+    {
+        frameTaken = false;
+        if (++frameHead >= GSXBEE_FRAME_SLOTS) frameHead = 0;
+        ++frameOut;
+    }
+#endif
+#if GSXBEE_SEND_SLOTS > 0
+    if (sendCount) txDispatch();                            //a TX status or AT response may have made room
+#endif
+    STAT(if (stat != NO_TRAFFIC) ++stats.readStatus[stat]);
+    if (initState > INIT_IDLE && initState < INIT_COMPLETE) initAdvance(stat);
+    else if (linkStatus == LINK_DOWN) linkAdvance();
+    return stat;
+}
+
+//get the next API frame from the XBee into the XBee response, if one is
+//waiting. the bytes are read from the port and assembled by frameByte(),
+//or taken from the frame queue (see rxByte()).
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::readFrame()
+{
+#if GSXBEE_FRAME_SLOTS > 0
+    rxPump();                                               //interrupts stay enabled, see rxPump()
+    frameClear();
+    if (frameIn != frameOut)                                //dispatch the oldest frame in place
+    {
+        frameSlot_t* f = &frameSlots[frameHead];
+        frameSet(f->apiID, f->data, f->len, f->checksum);
+        frameTaken = true;
+    }
+#else
+    frameClear();
+    while (port != NULL && port->available() > 0)
+    {
+        if (frameByte(port->read())) return;
+    }
+#endif
+}
+
+//send an API frame to the XBee, escaping it as XBee::send() does
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::writeFrame(XBeeRequest &request)
+{
+    if (port == NULL) return;
+    uint8_t len = request.getFrameDataLength();
+    uint8_t checksum = request.getApiId() + request.getFrameId();
+    port->write(START_BYTE);
+    writeByte(0);                                           //length MSB, frames are short
+    writeByte(len + 2);
+    writeByte(request.getApiId());
+    writeByte(request.getFrameId());
+    for (uint8_t i = 0; i < len; ++i)
+    {
+        uint8_t b = request.getFrameData(i);
+        checksum += b;
+        writeByte(b);
+    }
+    writeByte(0xFF - checksum);
+}
+
+//write one byte of an API frame, escaped if need be
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::writeByte(uint8_t b)
+{
+    if (b == START_BYTE || b == ESCAPE || b == XON || b == XOFF)
+    {
+        port->write(ESCAPE);
+        b ^= 0x20;
+    }
+    port->write(b);
+}
+
+//clear the last frame assembled by frameByte(), before reading more
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::frameClear()
+{
+    getResponse().setAvailable(false);
+    getResponse().setErrorCode(NO_ERROR);
+}
+
+//make a complete frame available in the XBee response
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::frameSet(uint8_t apiID, uint8_t* data, uint8_t len, uint8_t checksum)
+{
+    XBeeResponse &r = getResponse();
+    r.setFrameData(data);
+    r.setApiId(apiID);
+    r.setMsbLength(0);
+    r.setLsbLength(len + 1);
+    r.setFrameLength(len);
+    r.setChecksum(checksum);
+    r.setErrorCode(NO_ERROR);
+    r.setAvailable(true);
+}
+
+//for readFrame(): adds one byte received from the XBee to the
+//frame in the XBee response. returns true when the frame is complete and
+//its checksum is good.
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::frameByte(uint8_t b)
+{
+    XBeeResponse &r = getResponse();
+    int8_t f = framer.put(b, r.getFrameData());
+    if (f < 0) r.setErrorCode(framer.error);
+    if (f <= 0) return false;
+    frameSet(framer.apiID, r.getFrameData(), framer.dataLen, framer.checksum);
+    return true;
+}
+
+#if GSXBEE_FRAME_SLOTS > 0
+//add one byte received from the XBee to the frame queue. complete frames
+//with good checksums are queued for read(), which then only has to
+//dispatch them. rxByte() is safe to call from an interrupt service routine,
+//e.g. the UART receive interrupt, as long as only one routine calls it.
+//a frame that starts while the queue is full is dropped (frameOverruns).
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::rxByte(uint8_t b)
+{
+    if (b == START_BYTE) frameFull = (uint8_t)(frameIn - frameOut) >= GSXBEE_FRAME_SLOTS;
+    frameSlot_t* f = &frameSlots[frameTail];
+    int8_t r = framer.put(b, frameFull ? NULL : f->data);
+    if (r < 0)
+    {
+        ++frameErrors;
+    }
+    else if (r > 0)
+    {
+        if (frameFull)
+        {
+            ++frameOverruns;
+            return;
+        }
+        f->apiID = framer.apiID;
+        f->len = framer.dataLen;
+        f->checksum = framer.checksum;
+        if (++frameTail >= GSXBEE_FRAME_SLOTS) frameTail = 0;
+        ++frameIn;                                          //publish it
+    }
+}
+
+//move the bytes waiting in the serial port (set by begin() or setSerial())
+//to the frame queue. read() calls this, but it can also be called from a
+//timer interrupt, or from sketch code that runs for a long time, so that
+//frames aren't lost when the port's receive buffer overflows while read()
+//isn't being called. returns the number of bytes moved.
+//the queue needs no lock: rxByte() is its only producer and read() its only
+//consumer, and each advances its own 8-bit frame counter. if an interrupt
+//calls rxPump() while read() is already in it, the interrupt returns at once
+//and read() moves the bytes.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::rxPump()
+{
+    uint8_t n = 0;
+    if (port == NULL || rxPumping) return 0;
+    rxPumping = true;
+    while (port->available() > 0 && n < 255)
+    {
+        rxByte(port->read());
+        ++n;
+    }
+    rxPumping = false;
+    return n;
+}
+#endif
+
+//set where this instance prints its diagnostic messages (default GSXBEE_LOG),
+//e.g. a different port for each of several XBees, or NULL for none.
+//GSXBEE_LOG_LEVEL still determines which messages are compiled in.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::setLog(LogSink* out)
+{
+    logOut = out;
+}
+
+//returns LINK_DOWN from when the XBee disassociates (after initialization)
+//until it reassociates, else LINK_UP.
+template <class SerialPort, class LogSink>
+xbeeLinkState_t gsXBeeT<SerialPort, LogSink>::linkState()
+{
+    return linkStatus;
+}
+
+//reassociation recovery state machine. called from read() while the XBee is
+//disassociated. polls the association indicator (AI) with exponential backoff,
+//plus jitter so that nodes don't all query and then transmit at the same time
+//when the coordinator returns. batched values are held until the XBee
+//reassociates. resetting the MCU is the last resort, after reassocTimeout.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::linkAdvance()
+{
+    const uint16_t AI_BACKOFF_MIN(1000);                    //milliseconds between AI queries, doubles up to
+    const uint16_t AI_BACKOFF_MAX(32000);                   //this limit
+    uint32_t ms = millis();
+
+    if (assocStatus == 0)                                   //from an AI response or modem status
+    {
+        LOG_INFO(ms << F("\tXB REASC\t") << ms - linkDownSince << F("ms\n"));     //outage
+        TRACE(TR_REASSOC, 0, 0, (ms - linkDownSince) / 1000);
+        linkStatus = LINK_UP;
+        if (compID[0] == 0)                                 //initialization didn't get that far
+        {
+            uint8_t cmd[] = "NI";
+            sendCommand(cmd);
+        }
+        batchFlush();                                       //send the values held while disassociated
+    }
+    else if (disassocReset && reassocTimeout && ms - linkDownSince >= reassocTimeout)
+    {
+        mcuReset();                                         //restart and hope to reassociate
+    }
+    else if (ms - linkTimer >= linkWait)
+    {
+        uint8_t cmd[] = "AI";
+        sendCommand(cmd);
+        linkTimer = ms;
+        if (linkBackoff == 0) linkBackoff = AI_BACKOFF_MIN;
+        else linkBackoff = linkBackoff < AI_BACKOFF_MAX / 2 ? 2 * linkBackoff : AI_BACKOFF_MAX;
+        linkWait = linkBackoff + jitter(linkBackoff / 2);
+    }
+}
+
+//returns a random number less than n (n > 0) that also differs by node,
+//so that nodes running the same sketch with the same random seed don't
+//all get the same numbers.
+template <class SerialPort, class LogSink>
+uint16_t gsXBeeT<SerialPort, LogSink>::jitter(uint16_t n)
+{
+    uint16_t h = 0;
+    for (const char* c = compID; *c; ++c) h = h * 31 + *c;
+    return (h + random(n)) % n;
+}
+
+//process one frame of incoming traffic, if any
+template <class SerialPort, class LogSink>
+xbeeReadStatus_t gsXBeeT<SerialPort, LogSink>::readXBee()
+{
+    if (atInFlight) atExpire(millis());
+    if (txInFlight) txExpire(millis());
+    if (batchLen && batchTimeout && millis() - batchStart >= batchTimeout) batchFlush();
+#if GSXBEE_OUT_SLOTS > 0
+    if (outCount || storeCount) outService(millis());
+#endif
+#if GSXBEE_MSG_SLOTS > 0
+    if (msgComplete != NULL)                                //the caller has had its chance at the last message
+    {
+        msgComplete->state = MSG_FREE;
+        msgComplete = NULL;
+    }
+    if (msgAssembling) msgExpire(millis());
+#endif
+    readFrame();
+    if ( getResponse().isAvailable() )
+    {
+        uint32_t ms = millis();
+
+        uint8_t apiID = getResponse().getApiId();
+        switch (apiID)                                      //what kind of packet did we get?
+        {
+        case ZB_TX_STATUS_RESPONSE:                         //transmit status for packets we've sent
+            return txStatusResponse(ms);
+            break;
+
+        case AT_COMMAND_RESPONSE:                           //response to an AT command
+            return atCommandResponse();
+            break;
+
+        case MODEM_STATUS_RESPONSE:                         //XBee administrative messages
+            {
+                ModemStatusResponse zbMSR;
+                getResponse().getModemStatusResponse(zbMSR);
+                uint8_t msrResponse = zbMSR.getStatus();
+                switch (msrResponse)
+                {
+                case HARDWARE_RESET:
+                    LOG_INFO(ms << F("\tXB HW RST\n"));
+                    TRACE(TR_HW_RESET);
+                    STAT(++stats.mdmHwReset);
+                    break;
+                case ASSOCIATED:
+                    LOG_INFO(ms << F("\tXB ASC\n"));
+                    TRACE(TR_ASSOC);
+                    STAT(++stats.mdmAssoc);
+                    assocStatus = 0x00;
+                    break;
+                case DISASSOCIATED:
+                    LOG_ERROR(ms << F("\tXB DISASC\n"));
+                    TRACE(TR_DISASSOC);
+                    STAT(++stats.mdmDisassoc);
+                    assocStatus = 0xFF;
+                    if (linkStatus == LINK_UP && (initState == INIT_IDLE || initState == INIT_COMPLETE))
+                    {
+                        linkStatus = LINK_DOWN;             //start reassociation recovery
+                        linkDownSince = linkTimer = ms;
+                        linkWait = jitter(1000);            //first AI query
+                        linkBackoff = 0;
+                    }
+                    break;
+                default:
+                    LOG_INFO(ms << F("\tXB MDM STAT\t0x") << _HEX(msrResponse) << endl);
+                    TRACE(TR_MODEM_STATUS, msrResponse);
+                    STAT(++stats.mdmOther);
+                    break;
+                }
+            }
+            return MODEM_STATUS;
+            break;
+
+        case ZB_RX_RESPONSE:                                //rx data packet
+            getResponse().getZBRxResponse(zbRX);            //get the received data
+            switch (zbRX.getOption() & 0x01)                //check ack bit only
+            {
+            case ZB_PACKET_ACKNOWLEDGED:
+                //process the received data
+                LOG_INFO(ms << F("\tXB RX/ACK\n"));
+                TRACE(TR_RX_ACK);
+                if ( (parseErr = parsePacket()) == PARSE_OK )
+                {
+                    switch (packetType)                     // what type of packet
+                    {
+                    case 'D':                               // data headed for the web
+                    case 'M':                               // or mail/mqtt packet
+                    case 'H':                               // or link statistics, already in GroveStreams format
+                        rxEnqueue(ms);                      // queue it and ask for the received signal strength
+                        return RX_DATA;
+                        break;
+
+                    case 'B':                               // binary data, expand to a D packet
+                        if ( expandBinary() )
+                        {
+                            rxEnqueue(ms);
+                            return RX_DATA;
+                        }
+                        LOG_ERROR(ms << F("\tXB B packet decode error\n"));
+                        TRACE(TR_RX_MALFORMED, rxDataLen);
+                        return RX_ERROR;
+                        break;
+
+                    case 'F':                               // fragment of a longer message
+                        return fragReceive(ms);
+                        break;
+
+                    case 'S':                               // time sync packet
+                        return timeSyncReceived();
+                        break;
+
+                    default:                                //not expecting anything else
+                        LOG_ERROR(endl << ms << F("\tXB unknown packet type\n"));
+                        TRACE(TR_RX_UNKNOWN_TYPE, packetType);
+                        return RX_UNKNOWN;
+                        break;
+                    }
+                }
+                else
+                {
+#if GSXBEE_LOG_LEVEL >= GSXBEE_LOG_ERROR
+                    if (logOut)
+                    {
+                        uint8_t *d = zbRX.getData();
+                        uint8_t nChar = zbRX.getDataLength();
+                        *logOut << ms << F("\tMalformed packet:\t/");
+                        for ( uint8_t i = 0; i < nChar; ++i ) *logOut << (char)*d++;
+                        *logOut << '/' << nChar << F(" ERR=") << parseErr << endl;
+                    }
+#endif
+                    TRACE(TR_RX_MALFORMED, zbRX.getDataLength());
+                    return RX_ERROR;
+                }
+                break;
+
+            default:
+                if ( (zbRX.getOption() & ZB_BROADCAST_PACKET) && !isTimeServer
+                    && zbRX.getDataLength() > 1 && zbRX.getData()[1] == 'S' && (parseErr = parsePacket()) == PARSE_OK )
+                {
+                    return timeSyncReceived();              //time server answering several requests at once
+                }
+                LOG_INFO(ms << F("\tXB RX no ACK\n"));            //packet received and not ACKed
+                TRACE(TR_RX_NO_ACK);
+                return RX_NO_ACK;
+                break;
+            }
+            break;
+
+        case XB_ROUTE_RECORD:                               //route taken by a packet from a remote node
+            return routeRecord();
+            break;
+
+        case XB_MTO_REQUEST:                                //another node's many-to-one route request
+            LOG_INFO(ms << F("\tXB MTO REQ\n"));
+            return MTO_REQUEST;
+            break;
+
+        default:                                            //something else we were not expecting
+            LOG_ERROR(ms << F("\tXB UNEXP TYPE 0x") << _HEX(apiID) << endl);   //unexpected frame type
+            TRACE(TR_UNEXP_FRAME, apiID);
+            return UNKNOWN_FRAME;
+            break;
+        }
+    }
+    else
+    {
+        return NO_TRAFFIC;
+    }
+}
+
+//send an AT command to the XBee, optionally with a parameter value.
+//each command is sent with its own frame ID, which is returned (zero if
+//the command could not be sent). the response is processed in read(),
+//which calls the optional callback function with the response, or with
+//status AT_TIMEOUT if no response arrives within timeout milliseconds.
+//up to GSXBEE_AT_SLOTS commands can be awaiting responses at once.
+//a command with a slot waits in the send queue if the XBee has no room for it
+//(see txWindow); the timeout includes the time it waits.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::sendCommand(uint8_t* cmd, atCallback_t callback, uint16_t timeout, uint8_t* value, uint8_t valueLen)
+{
+    atSlot_t* slot = NULL;
+    for (uint8_t i = 0; i < GSXBEE_AT_SLOTS; ++i)
+    {
+        if (atSlots[i].frameID == 0)
+        {
+            slot = &atSlots[i];
+            break;
+        }
+    }
+    if (slot == NULL && callback != NULL) return 0;         //can't track the response, so can't honor the callback
+
+    uint8_t frameID = getNextFrameId();
+    uint32_t ms = millis();
+#if GSXBEE_SEND_SLOTS > 0
+    sendSlot_t* s = NULL;
+    if (slot != NULL && !txNow(PRI_CONTROL)) s = sendQueue(frameID, PRI_CONTROL, 0, valueLen + 2);
+    if (s != NULL)
+    {
+        s->data[0] = cmd[0];
+        s->data[1] = cmd[1];
+        if (valueLen) memcpy(s->data + 2, value, valueLen);
+    }
+    else
+#endif
+    atFrame(frameID, cmd, value, valueLen);
+    if (slot != NULL)
+    {
+        slot->frameID = frameID;
+        slot->cmd[0] = cmd[0];
+        slot->cmd[1] = cmd[1];
+        slot->timeout = timeout;
+        slot->msSent = ms;
+        slot->callback = callback;
+        ++atInFlight;
+    }
+    LOG_INFO(endl << ms << F("\tXB CMD\t") << (char)cmd[0] << (char)cmd[1] << ' ' << frameID << endl);
+    TRACE(TR_CMD, cmd[0], cmd[1], frameID);
+    return frameID;
+}
+
+//send an AT command frame to the XBee
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::atFrame(uint8_t frameID, uint8_t* cmd, uint8_t* value, uint8_t valueLen)
+{
+    AtCommandRequest atCmdReq = AtCommandRequest(cmd, value, valueLen);
+    atCmdReq.setFrameId(frameID);
+    writeFrame(atCmdReq);
+}
+
+//returns true if the AT command sent with the given frame ID is still awaiting a response.
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::atPending(uint8_t frameID)
+{
+    if (frameID == 0) return false;
+    for (uint8_t i = 0; i < GSXBEE_AT_SLOTS; ++i)
+    {
+        if (atSlots[i].frameID == frameID) return true;
+    }
+    return false;
+}
+
+//register a function to be called with every successful response to the given
+//AT command (e.g. "DB"), no matter who sent the command. read() returns
+//COMMAND_RESPONSE for these. returns false if GSXBEE_AT_HANDLERS are
+//already registered.
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::onCommand(const char* cmd, atCallback_t handler)
+{
+    for (uint8_t i = 0; i < GSXBEE_AT_HANDLERS; ++i)
+    {
+        atHandler_t* h = &atHandlers[i];
+        if (h->handler == NULL || (h->cmd[0] == cmd[0] && h->cmd[1] == cmd[1]))
+        {
+            h->cmd[0] = cmd[0];
+            h->cmd[1] = cmd[1];
+            h->handler = handler;
+            return true;
+        }
+    }
+    return false;
+}
+
+//process an AT command response. complete the matching in-flight command (if any),
+//then decode the response with the library's own decoders or a registered handler.
+template <class SerialPort, class LogSink>
+xbeeReadStatus_t gsXBeeT<SerialPort, LogSink>::atCommandResponse()
+{
+    AtCommandResponse atResp;
+    getResponse().getAtCommandResponse(atResp);
+    atResponse_t resp;
+    uint8_t* p = atResp.getCommand();                       //get the command
+    atCmdRecd[0] = resp.cmd[0] = *p++;
+    atCmdRecd[1] = resp.cmd[1] = *p++;
+    atCmdRecd[2] = resp.cmd[2] = 0;
+    resp.frameID = atResp.getFrameId();
+    resp.status = atResp.getStatus();
+    resp.valueLen = atResp.getValueLength();
+    resp.value = resp.valueLen > 0 ? atResp.getValue() : NULL;
+
+    xbeeReadStatus_t ret = COMMAND_RESPONSE;
+    bool decoded = false;
+    if (atResp.isOk())
+    {
+        decoded = true;
+        switch (resp.cmd[0] << 8 | resp.cmd[1])             //responses to these AT commands are decoded by the library
+        {
+        case 'A' << 8 | 'I':                                //association indication
+            decodeAI(resp);
+            ret = AI_CMD_RESPONSE;
+            break;
+        case 'D' << 8 | 'A':                                //force disassociation
+            ret = DA_CMD_RESPONSE;
+            break;
+        case 'D' << 8 | 'B':                                //received signal strength
+            decodeDB(resp);
+            ret = DB_CMD_RESPONSE;
+            break;
+        case 'F' << 8 | 'R':                                //firmware reset
+            ret = FR_CMD_RESPONSE;
+            break;
+        case 'N' << 8 | 'I':                                //node identifier
+            decodeNI(resp);
+            ret = NI_CMD_RESPONSE;
+            break;
+        case 'V' << 8 | 'R':                                //firmware version
+            decodeVR(resp);
+            ret = VR_CMD_RESPONSE;
+            break;
+        default:
+            decoded = false;
+            break;
+        }
+        for (uint8_t i = 0; i < GSXBEE_AT_HANDLERS; ++i)
+        {
+            atHandler_t* h = &atHandlers[i];
+            if (h->handler != NULL && h->cmd[0] == resp.cmd[0] && h->cmd[1] == resp.cmd[1])
+            {
+                h->handler(resp);
+                decoded = true;
+                break;
+            }
+        }
+    }
+    else
+    {
+        LOG_ERROR(millis() << F("\tAT CMD FAIL\t") << resp.cmd << ' ' << resp.status << endl);
+        TRACE(TR_CMD_FAIL, resp.cmd[0], resp.cmd[1], resp.status);
+        STAT(++stats.atFail);
+    }
+
+    for (uint8_t i = 0; i < GSXBEE_AT_SLOTS; ++i)
+    {
+        atSlot_t* slot = &atSlots[i];
+        if (slot->frameID != 0 && slot->frameID == resp.frameID && slot->cmd[0] == resp.cmd[0] && slot->cmd[1] == resp.cmd[1])
+        {
+            slot->frameID = 0;
+            --atInFlight;
+            if (slot->callback != NULL)
+            {
+                slot->callback(resp);
+                decoded = true;
+            }
+            break;
+        }
+    }
+    if (!decoded && atResp.isOk())
+    {
+        LOG_INFO(millis() << F("\tUNK CMD RESP\t") << atCmdRecd << endl);
+        TRACE(TR_CMD_UNKNOWN, resp.cmd[0], resp.cmd[1]);
+    }
+    return ret;
+}
+
+//call back any AT commands that have waited too long for a response.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::atExpire(uint32_t ms)
+{
+    for (uint8_t i = 0; i < GSXBEE_AT_SLOTS; ++i)
+    {
+        atSlot_t* slot = &atSlots[i];
+        if (slot->frameID != 0 && ms - slot->msSent >= slot->timeout)
+        {
+            atResponse_t resp;
+            resp.cmd[0] = slot->cmd[0];
+            resp.cmd[1] = slot->cmd[1];
+            resp.cmd[2] = 0;
+            resp.frameID = slot->frameID;
+            resp.status = AT_TIMEOUT;
+            resp.value = NULL;
+            resp.valueLen = 0;
+#if GSXBEE_SEND_SLOTS > 0
+            for (uint8_t j = 0; j < sendCount; ++j)         //it may not have been sent yet
+            {
+                if (sendSlots[j].packetType == 0 && sendSlots[j].frameID == slot->frameID) sendRemove(j);
+            }
+#endif
+            slot->frameID = 0;
+            --atInFlight;
+            LOG_ERROR(ms << F("\tAT CMD TIMEOUT\t") << resp.cmd << ' ' << resp.frameID << endl);
+            TRACE(TR_CMD_TIMEOUT, resp.cmd[0], resp.cmd[1], resp.frameID);
+            STAT(++stats.atTimeout);
+            if (slot->callback != NULL) slot->callback(resp);
+        }
+    }
+}
+
+//AI command (association indication)
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::decodeAI(atResponse_t &resp)
+{
+    if (resp.valueLen > 0) assocStatus = *resp.value;
+}
+
+//NI command (node identifier)
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::decodeNI(atResponse_t &resp)
+{
+    parseErr = parseNodeID((const char*)resp.value, resp.valueLen);
+    if (parseErr != PARSE_OK)
+    {
+        LOG_ERROR(millis() << F("\tXB NI ERR\t") << parseErr << endl);
+        TRACE(TR_RX_MALFORMED, resp.valueLen, parseErr);
+    }
+}
+
+//DB command (received signal strength of the last RF data packet)
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::decodeDB(atResponse_t &resp)
+{
+    if (resp.valueLen == 1) {
+        rss = -resp.value[0];
+        STAT(statsRSS(rss));
+        for (uint8_t n = 0, i = rxHead; n < rxCount; ++n)  //attach it to the packet it was requested for
+        {
+            if (rxQueue[i].rssFrameID == resp.frameID)
+            {
+                rxQueue[i].rss = rss;
+                rxQueue[i].rssFrameID = 0;
+                break;
+            }
+            if (++i >= GSXBEE_RX_SLOTS) i = 0;
+        }
+    }
+    else {
+        LOG_ERROR(millis() << F("\tRSS LEN ERR\n"));     //unexpected length
+        TRACE(TR_RSS_LEN_ERR, resp.valueLen);
+    }
+}
+
+//VR command (firmware version)
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::decodeVR(atResponse_t &resp)
+{
+    if (resp.valueLen >= 2) firmwareVersion = ( resp.value[0] << 8 ) + resp.value[1];
+}
+
+//Build & send an XBee data packet containing a character string destined for GroveStreams.
+//The data packet is defined as follows:
+//Byte  0:       SOH character (Start of header, 0x01)
+//Byte  1:       Packet type, defaults to D=data
+//Bytes 2-m:     (m <= 9) GroveStreams component ID, 1-8 characters.
+//Byte  m+1:     STX character (0x02), delimiter between header and data.
+//Bytes m+2-n:   (D packet) Data to be sent to GroveStreams, in
+//               GroveStreams' PUT feed API/URL format, terminated by a
+//               zero byte. The sending unit must format the data, e.g.:
+//               &streamID1=value1&streamID2=value2...&streamIDn=valuen
+//
+//The maximum XBee packet size is set by PAYLOAD_LEN at the top of this
+//file. Note there is an upper limit, see the XBee ATNP command.
+//Data too long for one packet is sent as a fragmented message, see fragBegin().
+//Returns the frame ID used for the transmission; its TX status is matched
+//by frame ID and reported to the TX callback function, if one is set.
+//For a fragmented message, returns the frame ID of the last fragment.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::sendData(char* data, char packetType)
+{
+    uint8_t hdrLen = header(packetType);
+    char *p = payload + hdrLen;
+    uint8_t maxLen = PAYLOAD_LEN - 1 - hdrLen;              //leave room for the zero terminator
+    uint8_t dataLen = 0;
+    while ( data[dataLen] != 0 )                            //copy in the data, measuring it as we go
+    {
+        if (dataLen >= maxLen)
+        {
+            fragBegin(packetType);
+            fragWrite(data);
+            return fragEnd();
+        }
+        p[dataLen] = data[dataLen];
+        ++dataLen;
+    }
+    p[dataLen] = 0;
+    return sendPacket(packetType, hdrLen + dataLen);
+}
+
+//Build & send an XBee data packet containing binary data, typically to another node.
+//Data too long for one packet is sent as a fragmented message, see fragBegin().
+//Returns the frame ID used for the transmission (of the last fragment if fragmented).
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::sendData(char packetType, uint8_t* data, uint8_t dataLen)
+{
+    if (dataLen > PAYLOAD_LEN - 3 - strlen(compID))         //SOH, packet type, STX
+    {
+        fragBegin(packetType);
+        fragWrite(data, dataLen);
+        return fragEnd();
+    }
+    uint8_t hdrLen = header(packetType);
+    memcpy(payload + hdrLen, data, dataLen);                //copy in the data
+    return sendPacket(packetType, hdrLen + dataLen);
+}
+
+//start a packet to be built in place, for data that is formatted as it is
+//produced (see also gsXBeeWriter). returns a pointer to the data area of
+//payload, after the header; up to packetRoom() bytes may be written there,
+//then call endPacket() with the number written. nothing else may be sent
+//or received in the meantime, as payload is shared.
+template <class SerialPort, class LogSink>
+char* gsXBeeT<SerialPort, LogSink>::beginPacket(char packetType)
+{
+    pktHeaderLen = header(packetType);
+    return payload + pktHeaderLen;
+}
+
+//returns the number of bytes that can be written to the packet started by
+//beginPacket(). one byte more is reserved for a zero terminator, so string
+//functions can be used to format the data.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::packetRoom()
+{
+    return pktHeaderLen ? PAYLOAD_LEN - 1 - pktHeaderLen : 0;
+}
+
+//send the packet started by beginPacket(), with dataLen bytes of data.
+//returns the frame ID, or zero if no packet was started or dataLen is
+//more than packetRoom().
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::endPacket(uint8_t dataLen)
+{
+    if (pktHeaderLen == 0) return 0;
+    if (dataLen > packetRoom())
+    {
+        LOG_ERROR(millis() << F("\tXB packet too long\t") << dataLen << endl);
+        pktHeaderLen = 0;
+        return 0;
+    }
+    uint8_t len = pktHeaderLen + dataLen;
+    pktHeaderLen = 0;
+    payload[len] = 0;
+    return sendPacket(payload[1], len);
+}
+
+//write the packet header (SOH, packet type, component ID, STX) to payload,
+//from the cached copy, rebuilding it if compID has changed. returns its length.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::header(char type)
+{
+    uint8_t idLen = txHeaderLen - 3;
+    if ( txHeaderLen == 0 || memcmp(txHeader + 2, compID, idLen) != 0 || compID[idLen] != 0 ) cacheHeader();
+    memcpy(payload, txHeader, txHeaderLen);
+    payload[1] = type;
+    return txHeaderLen;
+}
+
+//build the cached packet header from compID. the packet type is filled in
+//when it is used.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::cacheHeader()
+{
+    uint8_t idLen = strnlen(compID, sizeof(txHeader) - 3);
+    txHeader[0] = SOH;
+    memcpy(txHeader + 2, compID, idLen);
+    txHeader[idLen + 2] = STX;
+    txHeaderLen = idLen + 3;
+}
+
+//send the data packet in payload to destAddr. returns the frame ID.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::sendPacket(char type, uint8_t len)
+{
+    uint8_t frameID = sendPayload(destAddr, type, len);
+    LOG_INFO(endl << millis() << F("\tXB TX\t") << len << ' ' << frameID << endl);
+    TRACE(TR_TX, frameID, type, len);
+    return frameID;
+}
+
+//longest text a B packet may expand to, so that it fits in rxPacket_t.data
+const uint8_t EXPANDED_MAX(PAYLOAD_LEN - 4);
+
+//format a fixed-point value, scaled by 10^decimals, as a decimal number.
+//buf must hold at least 13 characters. returns the length of the text.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::formatFixed(char* buf, int32_t scaled, uint8_t decimals)
+{
+    char *p = buf;
+    uint32_t u = scaled;
+    if (scaled < 0)
+    {
+        *p++ = '-';
+        u = -u;
+    }
+    char digits[11];                                        //least significant first
+    uint8_t n = 0;
+    do
+    {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u != 0 || n <= decimals);                      //at least one digit before the decimal point
+    while (n > 0)
+    {
+        *p++ = digits[--n];
+        if (n == decimals && n > 0) *p++ = '.';
+    }
+    *p = 0;
+    return p - buf;
+}
+
+//add a stream value to the batch, in GroveStreams' format (&streamID=value).
+//if it won't fit in the packet with the values already batched, those are
+//sent first as a D packet. the batch is also sent batchTimeout milliseconds
+//after its first value was added, or by calling batchFlush(), e.g. at the
+//scheduled transmit time.
+//returns false (and adds nothing) if the value is too long for a packet,
+//if a stream dictionary is set (B packets carry numeric values only), or if
+//the batch is full and the XBee is disassociated.
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::batchAdd(const char* streamID, const char* value)
+{
+    if (streamDict != NULL) return false;
+#ifndef GSXBEE_FULL
+    if (fragLen > 0) return false;                          //batchBuf is in use as fragBuf
+#endif
+    uint8_t maxLen = PAYLOAD_LEN - 4 - strlen(compID);      //SOH, packet type, component ID, STX, zero terminator
+    uint8_t idLen = strlen(streamID);
+    uint8_t valLen = strlen(value);
+    uint16_t itemLen = idLen + valLen + 2;                  //& and =
+    if (itemLen > maxLen) return false;
+    if (batchLen + itemLen > maxLen && batchFlush() == 0) return false;     //full, and held while disassociated
+    if (batchLen == 0) batchStart = millis();
+    char *p = batchBuf + batchLen;
+    *p++ = '&';
+    memcpy(p, streamID, idLen);
+    p += idLen;
+    *p++ = '=';
+    memcpy(p, value, valLen + 1);                           //include the terminator
+    batchLen += itemLen;
+    return true;
+}
+
+//add an integer stream value to the batch
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::batchAdd(const char* streamID, int value)
+{
+    return batchAdd(streamID, (long)value);
+}
+
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::batchAdd(const char* streamID, long value)
+{
+    if (streamDict != NULL) return batchAddFixed(streamID, value, 0);
+    char buf[12];
+    return batchAdd(streamID, ltoa(value, buf, 10));
+}
+
+//add a floating-point stream value to the batch, with the given number of decimal places.
+//returns false if the value is too large to format, or is infinite or NaN.
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::batchAdd(const char* streamID, double value, uint8_t decimals)
+{
+    if (decimals > 7) decimals = 7;
+    if (streamDict != NULL)
+    {
+        double scaled = value;
+        for (uint8_t i = 0; i < decimals; ++i) scaled *= 10;
+        if ( !(fabs(scaled) < 2147483647.0) ) return false;
+        return batchAddFixed(streamID, scaled + (scaled < 0 ? -0.5 : 0.5), decimals);
+    }
+    double limit = 1e12;                                    //buf holds a sign, 12 - decimals digits, point, decimals
+    for (uint8_t i = 0; i < decimals; ++i) limit /= 10;
+    if ( !(fabs(value) < limit) ) return false;             //too long, or not a number
+    char buf[16];
+    return batchAdd(streamID, dtostrf(value, 1, decimals, buf));
+}
+
+//add a value to a B packet batch. each value is encoded as a header byte with
+//the stream's index in the dictionary (bits 7-3) and the number of decimal places
+//(bits 2-0), followed by the value scaled by 10^decimals as a zigzag varint,
+//i.e. seven bits per byte, least significant first, high bit set if more follow.
+//returns false if the stream ID is not in the dictionary, or if the batch is
+//full and the XBee is disassociated.
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::batchAddFixed(const char* streamID, int32_t scaled, uint8_t decimals)
+{
+    uint8_t idx;
+    for (idx = 0; idx < streamDictLen; ++idx)
+    {
+        if (strcmp(streamDict[idx], streamID) == 0) break;
+    }
+    if (idx >= streamDictLen) return false;
+#ifndef GSXBEE_FULL
+    if (fragLen > 0) return false;                          //batchBuf is in use as fragBuf
+#endif
+
+    uint8_t bin[6];
+    uint8_t n = 0;
+    bin[n++] = idx << 3 | decimals;
+    uint32_t z = ((uint32_t)scaled << 1) ^ (uint32_t)(scaled >> 31);
+    do
+    {
+        uint8_t b = z & 0x7F;
+        z >>= 7;
+        bin[n++] = z ? b | 0x80 : b;
+    } while (z != 0);
+
+    char text[13];
+    uint8_t textLen = strlen(streamID) + 2 + formatFixed(text, scaled, decimals);
+    uint8_t maxLen = PAYLOAD_LEN - 3 - strlen(compID);      //SOH, packet type, component ID, STX
+    if ( (batchLen + n > maxLen || batchTextLen + textLen > EXPANDED_MAX) && batchFlush() == 0 ) return false;
+    if (batchLen == 0) batchStart = millis();
+    memcpy(batchBuf + batchLen, bin, n);
+    batchLen += n;
+    batchTextLen += textLen;
+    return true;
+}
+
+//send the batched values as a D packet, or a B packet if a stream dictionary is set.
+//while the XBee is disassociated, the values are held and sent when it
+//reassociates; batchAdd() returns false once the batch is full.
+//the values are never sent as a fragmented message (fragBuf may share
+//batchBuf): if the component ID has grown since they were batched so that
+//they no longer fit one packet, they are split across several, between values.
+//returns the frame ID (of the last packet), or zero if the batch was empty or
+//is being held.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::batchFlush()
+{
+    if (batchLen == 0 || linkStatus == LINK_DOWN) return 0;
+    uint8_t len = batchLen;
+    batchLen = batchTextLen = 0;
+    bool binary = streamDict != NULL;
+    uint8_t room = PAYLOAD_LEN - 3 - strlen(compID) - !binary;     //SOH, packet type, component ID, STX, zero terminator
+    uint8_t frameID = 0;
+    uint8_t start = 0;
+    while (start < len)
+    {
+        uint8_t end = start;                                //end of the values that fit
+        uint8_t next = start;
+        while (next < len)
+        {
+            ++next;                                         //past a B header byte or a D &
+            if (binary)
+            {
+                while (next < len && (batchBuf[next] & 0x80)) ++next;
+                ++next;                                     //the varint's last byte
+            }
+            else
+            {
+                while (next < len && batchBuf[next] != '&') ++next;
+            }
+            if (next - start > room) break;
+            end = next;
+        }
+        if (end == start)                                   //a single value too long for a packet
+        {
+            LOG_ERROR(millis() << F("\tXB BATCH VALUE TOO LONG\n"));
+            start = next;
+            continue;
+        }
+        if (binary)
+        {
+            frameID = sendData('B', (uint8_t*)batchBuf + start, end - start);
+        }
+        else
+        {
+            char c = batchBuf[end];
+            batchBuf[end] = 0;
+            frameID = sendData(batchBuf + start);
+            batchBuf[end] = c;
+        }
+        start = end;
+    }
+    return frameID;
+}
+
+//set the stream IDs that B packets can carry, at most 32. once set, the batch
+//functions send B packets, with the numeric values in binary and each stream
+//ID replaced by its index in streamIDs. the receiver must set the same
+//dictionary; read() expands B packets into D packets in payload, so they can
+//be forwarded to GroveStreams unchanged. pass NULL to go back to D packets.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::setStreamDict(const char* const* streamIDs, uint8_t n)
+{
+    batchFlush();
+    batchLen = batchTextLen = 0;                            //values held while disassociated can't be sent with a new dictionary
+    streamDict = streamIDs;
+    streamDictLen = streamIDs != NULL && n > 32 ? 32 : n;
+}
+
+//expand the B packet in payload into GroveStreams' format, and change the
+//packet type to D. returns false if the packet can't be decoded with the
+//stream dictionary or expands to more than EXPANDED_MAX characters.
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::expandBinary()
+{
+    uint8_t bin[PAYLOAD_LEN];
+    uint8_t binLen = rxDataLen;
+    memcpy(bin, payload, binLen);
+    char *p = payload;
+    uint8_t i = 0;
+    while (i < binLen)
+    {
+        uint8_t idx = bin[i] >> 3;
+        uint8_t decimals = bin[i++] & 0x07;
+        if (idx >= streamDictLen) return false;
+        uint32_t z = 0;
+        for (uint8_t shift = 0; ; shift += 7)
+        {
+            if (i >= binLen || shift > 28) return false;    //truncated or too long
+            uint8_t b = bin[i++];
+            z |= (uint32_t)(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) break;
+        }
+        char text[13];
+        uint8_t textLen = formatFixed(text, (int32_t)(z >> 1) ^ -(int32_t)(z & 1), decimals);
+        const char* id = streamDict[idx];
+        uint8_t idLen = strlen(id);
+        if (p - payload + idLen + textLen + 2 > EXPANDED_MAX) return false;
+        *p++ = '&';
+        memcpy(p, id, idLen);
+        p += idLen;
+        *p++ = '=';
+        memcpy(p, text, textLen);
+        p += textLen;
+    }
+    *p = 0;
+    rxDataLen = p - payload;
+    packetType = 'D';
+    return true;
+}
+
+//returns the number of characters of stream data waiting in the batch
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::batchLength()
+{
+    return batchLen;
+}
+
+//send data to another node by its component ID, which must be in the address
+//cache, i.e. a packet must have been received from it recently (see lookup()).
+//returns the frame ID, or zero if the component ID is not in the cache.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::sendTo(const char* destCompID, char* data, char packetType)
+{
+    XBeeAddress64 dest;
+    if ( !lookup(destCompID, dest) ) return 0;
+    XBeeAddress64 saveDest = destAddr;
+    destAddr = dest;
+    uint8_t frameID = sendData(data, packetType);
+    destAddr = saveDest;
+    return frameID;
+}
+
+//find a node's 64-bit address in the address cache, by its component ID.
+//the cache holds the GSXBEE_ADDR_SLOTS nodes most recently received from or sent to.
+//returns false if the component ID is not in the cache.
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::lookup(const char* compID, XBeeAddress64 &addr)
+{
+    for (uint8_t i = 0; i < GSXBEE_ADDR_SLOTS; ++i)
+    {
+        addrSlot_t* a = &addrCache[i];
+        if (a->compID[0] != 0 && strcmp(a->compID, compID) == 0)
+        {
+            a->lastUsed = ++addrClock;
+            addr = a->addr;
+            return true;
+        }
+    }
+    return false;
+}
+
+//add or refresh a node's addresses in the address cache, replacing the
+//least recently used entry if the cache is full.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::addrLearn(const char* id, XBeeAddress64 &addr, uint16_t addr16)
+{
+    addrSlot_t* slot = NULL;
+    for (uint8_t i = 0; i < GSXBEE_ADDR_SLOTS; ++i)
+    {
+        addrSlot_t* a = &addrCache[i];
+        if (a->compID[0] != 0 && a->addr.getMsb() == addr.getMsb() && a->addr.getLsb() == addr.getLsb())
+        {
+            slot = a;                                       //already known
+            break;
+        }
+        if (a->compID[0] == 0)                              //prefer a free slot
+        {
+            if (slot == NULL || slot->compID[0] != 0) slot = a;
+        }
+        else if (slot == NULL || (slot->compID[0] != 0 && (uint16_t)(addrClock - a->lastUsed) > (uint16_t)(addrClock - slot->lastUsed)))
+        {
+            slot = a;                                       //least recently used so far
+        }
+    }
+    strcpy(slot->compID, id);
+    slot->addr = addr;
+    slot->addr16 = addr16;
+    slot->lastUsed = ++addrClock;
+}
+
+//returns the 16-bit network address for a 64-bit address, or 0xFFFE if not known
+template <class SerialPort, class LogSink>
+uint16_t gsXBeeT<SerialPort, LogSink>::addrFind16(XBeeAddress64 &addr)
+{
+    if (addr.getMsb() == 0 && addr.getLsb() == 0) return 0x0000;                //the coordinator
+    for (uint8_t i = 0; i < GSXBEE_ADDR_SLOTS; ++i)
+    {
+        addrSlot_t* a = &addrCache[i];
+        if (a->compID[0] != 0 && a->addr.getMsb() == addr.getMsb() && a->addr.getLsb() == addr.getLsb())
+        {
+            a->lastUsed = ++addrClock;
+            return a->addr16;
+        }
+    }
+    return 0xFFFE;
+}
+
+//update the 16-bit network address for a cached node, if it's in the cache.
+//0xFFFD (unknown, as reported in a TX status) is ignored.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::addrUpdate16(XBeeAddress64 &addr, uint16_t addr16)
+{
+    if (addr16 == 0xFFFD) return;
+    for (uint8_t i = 0; i < GSXBEE_ADDR_SLOTS; ++i)
+    {
+        addrSlot_t* a = &addrCache[i];
+        if (a->compID[0] != 0 && a->addr.getMsb() == addr.getMsb() && a->addr.getLsb() == addr.getLsb())
+        {
+            a->addr16 = addr16;
+            return;
+        }
+    }
+}
+
+//set the coordinator's many-to-one route broadcast interval (AR command),
+//in units of 10 seconds; 0 for a single broadcast, 0xFF (the XBee's default)
+//to disable them. remote nodes then send a route record ahead of each packet to
+//the coordinator, which keeps the routes and gives them to the XBee as source
+//routes for its replies, so it need not discover routes to the nodes.
+//returns the frame ID of the AT command.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::setManyToOne(uint8_t interval)
+{
+    uint8_t cmd[] = { 'A', 'R' };
+    return sendCommand(cmd, NULL, 1000, &interval, 1);
+}
+
+//returns the number of intermediate hops in the source route to a node,
+//or -1 if there is none.
+template <class SerialPort, class LogSink>
+int8_t gsXBeeT<SerialPort, LogSink>::routeHops(XBeeAddress64 &addr)
+{
+#if GSXBEE_ROUTE_SLOTS > 0
+    for (uint8_t i = 0; i < GSXBEE_ROUTE_SLOTS; ++i)
+    {
+        routeSlot_t* r = &routes[i];
+        if (r->nHops != 0xFF && r->addr.getMsb() == addr.getMsb() && r->addr.getLsb() == addr.getLsb()) return r->nHops;
+    }
+#else
+    (void)addr;
+#endif
+    return -1;
+}
+
+//process a Route Record Indicator frame (0xA1):
+//Bytes 0-7:     64-bit address of the remote node
+//Bytes 8-9:     16-bit address of the remote node
+//Byte  10:      receive options
+//Byte  11:      number of intermediate hops
+//Bytes 12-n:    16-bit addresses of the intermediate hops
+//the route is kept in the route table, replacing the least recently used
+//one if it's full.
+//routes longer than GSXBEE_ROUTE_HOPS are not kept.
+template <class SerialPort, class LogSink>
+xbeeReadStatus_t gsXBeeT<SerialPort, LogSink>::routeRecord()
+{
+    uint8_t* d = getResponse().getFrameData();
+    uint8_t len = getResponse().getFrameDataLength();
+    if (len < 12 || len < 12 + 2 * d[11]) return UNKNOWN_FRAME;
+    XBeeAddress64 addr( (uint32_t)d[0] << 24 | (uint32_t)d[1] << 16 | (uint16_t)d[2] << 8 | d[3],
+        (uint32_t)d[4] << 24 | (uint32_t)d[5] << 16 | (uint16_t)d[6] << 8 | d[7] );
+    uint16_t addr16 = d[8] << 8 | d[9];
+    addrUpdate16(addr, addr16);
+    STAT(++stats.routeRecords);
+    LOG_INFO(millis() << F("\tXB ROUTE\t") << _HEX(addr.getLsb()) << ' ' << d[11] << endl);
+    TRACE(TR_ROUTE_RECORD, d[11], 0, addr16);
+
+#if GSXBEE_ROUTE_SLOTS > 0
+    uint8_t nHops = d[11];
+    routeForget(addr);
+    if (nHops <= GSXBEE_ROUTE_HOPS)
+    {
+        routeSlot_t* slot = &routes[0];
+        for (uint8_t i = 0; i < GSXBEE_ROUTE_SLOTS; ++i)
+        {
+            routeSlot_t* r = &routes[i];
+            if (r->nHops == 0xFF)
+            {
+                slot = r;
+                break;
+            }
+            if ((uint16_t)(addrClock - r->lastUsed) > (uint16_t)(addrClock - slot->lastUsed)) slot = r;  //least recently used
+        }
+        slot->addr = addr;
+        slot->addr16 = addr16;
+        slot->nHops = nHops;
+        slot->lastUsed = ++addrClock;
+        for (uint8_t i = 0; i < nHops; ++i) slot->hops[i] = d[12 + 2 * i] << 8 | d[13 + 2 * i];
+    }
+#endif
+    return ROUTE_RECORD;
+}
+
+//if there is a route to dest in the route table, give it to the XBee with a
+//Create Source Route frame ahead of the transmission, and supply the 16-bit
+//address from the route record. the XBee does not keep source routes, so this
+//is done for every transmission.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::sourceRoute(XBeeAddress64 &dest, uint16_t &addr16)
+{
+#if GSXBEE_ROUTE_SLOTS > 0
+    for (uint8_t i = 0; i < GSXBEE_ROUTE_SLOTS; ++i)
+    {
+        routeSlot_t* r = &routes[i];
+        if (r->nHops != 0xFF && r->addr.getMsb() == dest.getMsb() && r->addr.getLsb() == dest.getLsb())
+        {
+            addr16 = r->addr16;
+            r->lastUsed = ++addrClock;
+            if (r->nHops > 0)                               //neighbors don't need a source route
+            {
+                CreateSourceRouteRequest csr(r->addr, r->addr16, r->nHops, r->hops);
+                writeFrame(csr);
+                STAT(++stats.sourceRoutes);
+                TRACE(TR_SOURCE_ROUTE, r->nHops, 0, r->addr16);
+            }
+            return;
+        }
+    }
+#else
+    (void)dest;
+    (void)addr16;
+#endif
+}
+
+//remove the route to dest from the route table, if there is one
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::routeForget(XBeeAddress64 &dest)
+{
+#if GSXBEE_ROUTE_SLOTS > 0
+    for (uint8_t i = 0; i < GSXBEE_ROUTE_SLOTS; ++i)
+    {
+        routeSlot_t* r = &routes[i];
+        if (r->nHops != 0xFF && r->addr.getMsb() == dest.getMsb() && r->addr.getLsb() == dest.getLsb()) r->nHops = 0xFF;
+    }
+#else
+    (void)dest;
+#endif
+}
+
+//Start a message that may be too long for one packet. Write the message
+//with fragWrite(), as many times as needed, then call fragEnd(). The
+//message is sent as a series of F packets, each holding as much of the
+//message as fits, without staging the whole message in RAM:
+//Byte  0:       Message ID, assigned by the sender (1-255)
+//Byte  1:       Fragment sequence number (0-127), high bit set on the last fragment
+//Byte  2:       Packet type of the message
+//Bytes 3-n:     Message data
+//The receiver reassembles the message and read() returns RX_MESSAGE, see
+//getMessage(). If a fragment is lost, the whole message is discarded.
+//Messages are limited to 128 fragments, and by GSXBEE_MSG_LEN on the receiver.
+//If a message was already started, it is ended first.
+//Returns the message ID.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::fragBegin(char packetType)
+{
+    if (fragLen > 0) fragEnd();
+#ifndef GSXBEE_FULL
+    batchFlush();                                           //fragBuf shares batchBuf
+    batchLen = batchTextLen = 0;                            //values held while disassociated are lost
+#endif
+    if (++fragMsgID == 0) fragMsgID = 1;
+    fragBuf[0] = fragMsgID;
+    fragBuf[1] = 0;
+    fragBuf[2] = packetType;
+    fragLen = 3;
+    return fragMsgID;
+}
+
+//add data to the message started by fragBegin(). each time a fragment
+//fills, it is sent. returns the number of bytes accepted, which is less
+//than len only if no message was started or it reached 128 fragments.
+template <class SerialPort, class LogSink>
+uint16_t gsXBeeT<SerialPort, LogSink>::fragWrite(const uint8_t* data, uint16_t len)
+{
+    if (fragLen == 0) return 0;
+    uint8_t maxLen = PAYLOAD_LEN - 3 - strlen(compID);      //SOH, packet type, component ID, STX
+    uint16_t n;
+    for (n = 0; n < len; ++n)
+    {
+        if (fragLen >= maxLen)                              //full, and there is more to come
+        {
+            if (fragBuf[1] >= 127) break;                   //out of sequence numbers
+            fragSend(false);
+        }
+        fragBuf[fragLen++] = data[n];
+    }
+    return n;
+}
+
+//add a zero-terminated string to the message started by fragBegin()
+template <class SerialPort, class LogSink>
+uint16_t gsXBeeT<SerialPort, LogSink>::fragWrite(const char* data)
+{
+    return fragWrite((const uint8_t*)data, strlen(data));
+}
+
+//send the last fragment of the message started by fragBegin().
+//returns its frame ID, or zero if no message was started.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::fragEnd()
+{
+    if (fragLen == 0) return 0;
+    uint8_t frameID = fragSend(true);
+    fragLen = 0;
+    return frameID;
+}
+
+//send the fragment in fragBuf and start the next one. returns the frame ID.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::fragSend(bool last)
+{
+    if (last) fragBuf[1] |= 0x80;
+    uint8_t frameID = sendData('F', fragBuf, fragLen);
+    ++fragBuf[1];
+    fragLen = 3;
+    return frameID;
+}
+
+//returns the message that read() just reassembled (when it returns RX_MESSAGE),
+//or NULL if none. the message is valid until read() is called again.
+template <class SerialPort, class LogSink>
+rxMessage_t* gsXBeeT<SerialPort, LogSink>::getMessage()
+{
+#if GSXBEE_MSG_SLOTS > 0
+    return msgComplete != NULL ? &msgComplete->msg : NULL;
+#else
+    return NULL;
+#endif
+}
+
+//add the fragment (F packet) just parsed to the message it belongs to.
+//a message is reassembled in a slot allocated by its first fragment; if all
+//GSXBEE_MSG_SLOTS are in use, the message that has waited longest is discarded.
+//returns RX_MESSAGE when the message is complete, RX_FRAGMENT if more fragments
+//are needed, or RX_ERROR if the fragment was discarded.
+template <class SerialPort, class LogSink>
+xbeeReadStatus_t gsXBeeT<SerialPort, LogSink>::fragReceive(uint32_t ms)
+{
+#if GSXBEE_MSG_SLOTS > 0
+    if (rxDataLen < 3) return RX_ERROR;
+    uint8_t msgID = payload[0];
+    uint8_t seq = payload[1] & 0x7F;
+    bool last = payload[1] & 0x80;
+    uint8_t len = rxDataLen - 3;
+
+    msgSlot_t* slot = NULL;
+    for (uint8_t i = 0; i < GSXBEE_MSG_SLOTS; ++i)
+    {
+        msgSlot_t* s = &msgSlots[i];
+        if (s->state == MSG_ASSEMBLING && s->msg.msgID == msgID
+            && s->msg.addr.getMsb() == sendingAddr.getMsb() && s->msg.addr.getLsb() == sendingAddr.getLsb())
+        {
+            slot = s;
+            break;
+        }
+    }
+    if (seq == 0)                                           //first fragment, start the message
+    {
+        if (slot == NULL)
+        {
+            for (uint8_t i = 0; i < GSXBEE_MSG_SLOTS; ++i)
+            {
+                msgSlot_t* s = &msgSlots[i];
+                if (s->state == MSG_FREE)
+                {
+                    slot = s;
+                    break;
+                }
+                if (slot == NULL || s->msg.ms - slot->msg.ms > 0x7FFFFFFF) slot = s;    //the oldest, in case all are in use
+            }
+            if (slot->state == MSG_ASSEMBLING)
+            {
+                LOG_ERROR(ms << F("\tXB MSG DROPPED\t") << slot->msg.compID << ' ' << slot->msg.msgID << endl);
+                TRACE(TR_MSG_DROPPED, slot->msg.msgID, slot->nextSeq);
+            }
+            else
+            {
+                ++msgAssembling;
+            }
+        }
+        slot->state = MSG_ASSEMBLING;
+        slot->nextSeq = 0;
+        slot->msg.packetType = payload[2];
+        strcpy(slot->msg.compID, sendingCompID);
+        slot->msg.addr = sendingAddr;
+        slot->msg.msgID = msgID;
+        slot->msg.len = 0;
+    }
+    if (slot == NULL || seq != slot->nextSeq || slot->msg.len + len > GSXBEE_MSG_LEN)
+    {
+        LOG_ERROR(ms << F("\tXB MSG FRAG ERR\t") << sendingCompID << ' ' << msgID << ' ' << seq << endl);
+        TRACE(TR_MSG_DROPPED, msgID, seq);
+        if (slot != NULL)
+        {
+            slot->state = MSG_FREE;
+            --msgAssembling;
+        }
+        return RX_ERROR;
+    }
+    memcpy(slot->msg.data + slot->msg.len, payload + 3, len);
+    slot->msg.len += len;
+    slot->msg.ms = ms;
+    ++slot->nextSeq;
+    if (!last) return RX_FRAGMENT;
+
+    slot->msg.data[slot->msg.len] = 0;
+    slot->state = MSG_COMPLETE;
+    --msgAssembling;
+    msgComplete = slot;
+    LOG_INFO(ms << F("\tXB MSG\t") << slot->msg.compID << ' ' << slot->msg.len << F("b\n"));
+    TRACE(TR_MSG, msgID, slot->msg.packetType, slot->msg.len);
+    return RX_MESSAGE;
+#else
+    (void)ms;
+    return RX_UNKNOWN;
+#endif
+}
+
+#if GSXBEE_MSG_SLOTS > 0
+//discard messages whose next fragment has not arrived
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::msgExpire(uint32_t ms)
+{
+    for (uint8_t i = 0; i < GSXBEE_MSG_SLOTS; ++i)
+    {
+        msgSlot_t* s = &msgSlots[i];
+        if (s->state == MSG_ASSEMBLING && ms - s->msg.ms >= MSG_TIMEOUT)
+        {
+            LOG_ERROR(ms << F("\tXB MSG TIMEOUT\t") << s->msg.compID << ' ' << s->msg.msgID << endl);
+            TRACE(TR_MSG_DROPPED, s->msg.msgID, s->nextSeq);
+            s->state = MSG_FREE;
+            --msgAssembling;
+        }
+    }
+}
+#endif
+
+//parse a received packet; check format, extract GroveStreams component ID and data.
+//the header is scanned once, bounded by the packet length, and nothing is
+//changed unless it's valid. returns PARSE_OK, or the error in the format:
+//PARSE_TOO_SHORT (less than SOH, packet type, STX), PARSE_NO_SOH, PARSE_NO_STX,
+//PARSE_COMPID_LEN (component ID empty or longer than 8 characters), or
+//PARSE_TOO_LONG (data doesn't fit in payload).
+template <class SerialPort, class LogSink>
+xbeeParseErr_t gsXBeeT<SerialPort, LogSink>::parsePacket()
+{
+    uint8_t *d = zbRX.getData();
+    uint8_t len = zbRX.getDataLength();
+    if ( len < 3 ) return PARSE_TOO_SHORT;
+    if ( d[0] != SOH ) return PARSE_NO_SOH;                 //check for SOH start character
+    uint8_t stx = 2;                                        //look for STX after the component ID
+    while ( stx < len && d[stx] != STX )
+    {
+        if ( stx >= 10 ) return PARSE_COMPID_LEN;           //more than 8 characters
+        ++stx;
+    }
+    if ( stx >= len ) return PARSE_NO_STX;
+    if ( stx == 2 ) return PARSE_COMPID_LEN;
+    uint8_t dataLen = len - stx - 1;
+    if ( dataLen >= PAYLOAD_LEN ) return PARSE_TOO_LONG;    //leave room for the terminator
+
+    packetType = d[1];                                      //save the packet type
+    memcpy(sendingCompID, d + 2, stx - 2);                  //the component ID
+    sendingCompID[stx - 2] = 0;
+    memcpy(payload, d + stx + 1, dataLen);                  //and the rest of the payload data
+    payload[dataLen] = 0;
+    rxDataLen = dataLen;
+    sendingAddr = zbRX.getRemoteAddress64();                //save the sender's address
+    addrLearn(sendingCompID, sendingAddr, zbRX.getRemoteAddress16());
+    LOG_INFO(millis() << F("\tXB RX\t") << sendingCompID << ' ' << len << F("b\n"));
+    TRACE(TR_RX, packetType, len);
+    return PARSE_OK;
+}
+
+//ask the XBee for the received signal strength of the last RF data packet, per rssPolicy.
+//does not wait for the response; rss is updated by read() when it arrives.
+//returns the frame ID of the DB command, or zero if none was sent.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::requestRSS()
+{
+    if (rssPolicy == RSS_OFF) return 0;
+    if (rssPolicy == RSS_SAMPLED && ++rssCount < rssSampleN) return 0;
+    rssCount = 0;
+    uint8_t atCmd[] = { 'D', 'B' };
+    return sendCommand(atCmd, NULL, 100);
+}
+
+//add the data packet just parsed to the receive queue and request its RSS.
+//if the queue is full, the packet is dropped (but is still available in payload, etc.)
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::rxEnqueue(uint32_t ms)
+{
+    uint8_t rssFrameID = requestRSS();
+    if (rxCount >= GSXBEE_RX_SLOTS)
+    {
+        ++rxOverruns;
+        STAT(++stats.rxOverruns);
+        LOG_ERROR(ms << F("\tXB RX QUEUE FULL\n"));
+        TRACE(TR_RX_QUEUE_FULL);
+        return;
+    }
+    uint8_t i = rxHead + rxCount;
+    if (i >= GSXBEE_RX_SLOTS) i -= GSXBEE_RX_SLOTS;
+    rxPacket_t* pkt = &rxQueue[i];
+    pkt->packetType = packetType;
+    strcpy(pkt->compID, sendingCompID);
+    pkt->addr = sendingAddr;
+    pkt->addr16 = zbRX.getRemoteAddress16();
+    pkt->rss = 0;
+    pkt->rssFrameID = rssFrameID;
+    pkt->ms = ms;
+    uint8_t len = rxDataLen < sizeof(pkt->data) ? rxDataLen : sizeof(pkt->data) - 1;
+    memcpy(pkt->data, payload, len);
+    pkt->data[len] = 0;
+    pkt->len = len;
+    ++rxCount;
+}
+
+//returns the transmit time of the first slot at or after utc, for a node that
+//transmits at second sec of every interval'th minute, offset by offset minutes.
+//minutes are counted from the epoch, so e.g. a 5-minute interval transmits at
+//00:00, 00:05, etc. plus the offset. returns 0xFFFFFFFF if interval is zero.
+template <class SerialPort, class LogSink>
+uint32_t gsXBeeT<SerialPort, LogSink>::nextSlot(uint32_t utc, uint8_t sec, uint8_t interval, uint8_t offset)
+{
+    if (interval == 0) return 0xFFFFFFFF;
+    uint32_t minute = utc / 60;
+    uint8_t phase = (minute + interval - offset % interval) % interval;    //minutes since the last scheduled minute
+    uint8_t ahead = (interval - phase) % interval;          //minutes to the next scheduled minute
+    uint32_t t = (minute + ahead) * 60 + sec;
+    return t >= utc ? t : t + interval * 60UL;
+}
+
+//returns true if two nodes' transmission slots ever fall in the same second.
+//the slots coincide in some minute if and only if the offsets are congruent
+//modulo the greatest common divisor of the intervals (Chinese remainder theorem).
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::slotsCollide(uint8_t secA, uint8_t intervalA, uint8_t offsetA, uint8_t secB, uint8_t intervalB, uint8_t offsetB)
+{
+    if (secA != secB || intervalA == 0 || intervalB == 0) return false;
+    uint8_t a = intervalA, b = intervalB;
+    while (b != 0)
+    {
+        uint8_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return offsetA % a == offsetB % a;
+}
+
+//returns our next transmit time at or after utc, per the schedule in our Node ID
+template <class SerialPort, class LogSink>
+uint32_t gsXBeeT<SerialPort, LogSink>::nextTransmit(uint32_t utc)
+{
+    return nextSlot(utc, txSec, txInterval, txOffset);
+}
+
+//returns the first warmup time (txWarmup seconds before a transmit time) at or after utc
+template <class SerialPort, class LogSink>
+uint32_t gsXBeeT<SerialPort, LogSink>::nextWarmup(uint32_t utc)
+{
+    return nextTransmit(utc + txWarmup) - txWarmup;
+}
+
+//set functions to be called by schedule() at warmup time and transmit time.
+//each is called with the transmit time. either can be NULL.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::setScheduleCallbacks(scheduleCallback_t warmup, scheduleCallback_t transmit)
+{
+    warmupCallback = warmup;
+    transmitCallback = transmit;
+    schedTX = 0;
+}
+
+//call at least once a second with the current time, e.g. after the second rolls
+//over. calls the warmup callback txWarmup seconds before each transmit time, then
+//the transmit callback at the transmit time. if calls are missed, each callback
+//is called once, late, for the missed slot. if the clock is set back, the
+//schedule starts over from the new time.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::schedule(uint32_t utc)
+{
+    if (txInterval == 0) return;                            //no schedule until the Node ID is known
+    if (schedTX == 0 || (schedTX > utc && schedTX - utc > txInterval * 60UL + txWarmup))
+    {
+        schedTX = nextTransmit(utc);
+        schedWarmedUp = false;
+    }
+    if (!schedWarmedUp && utc + txWarmup >= schedTX)
+    {
+        schedWarmedUp = true;
+        if (warmupCallback != NULL) warmupCallback(schedTX);
+    }
+    if (utc >= schedTX)
+    {
+        uint32_t t = schedTX;
+        schedTX = nextTransmit(utc + 1);
+        schedWarmedUp = false;
+        if (transmitCallback != NULL) transmitCallback(t);
+    }
+}
+
+//returns the number of received data packets in the queue
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::available()
+{
+    rxQueueUsed = true;
+    return rxCount;
+}
+
+//returns a pointer to the oldest received data packet in the queue, or NULL if the queue is empty.
+//the packet remains valid until pop() is called.
+template <class SerialPort, class LogSink>
+rxPacket_t* gsXBeeT<SerialPort, LogSink>::peek()
+{
+    rxQueueUsed = true;
+    return rxCount ? &rxQueue[rxHead] : NULL;
+}
+
+//remove the oldest received data packet from the queue
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::pop()
+{
+    rxQueueUsed = true;
+    if (rxCount == 0) return;
+    if (++rxHead >= GSXBEE_RX_SLOTS) rxHead = 0;
+    --rxCount;
+}
+
+//parse Node ID in format compID_ssmmnnww, in a single pass.
+//compID must be 1-8 characters, the remainder must be exactly "_" followed by 8 digits,
+//with mm not zero (else PARSE_NI_FORMAT), ss < 60 and nn < mm.
+//the NI is parsed in place in the AT command response (no copy is made), and
+//nothing is changed unless it's valid. returns PARSE_OK, PARSE_NI_FORMAT or PARSE_NI_RANGE.
+template <class SerialPort, class LogSink>
+xbeeParseErr_t gsXBeeT<SerialPort, LogSink>::parseNodeID(const char* ni, uint8_t len)
+{
+    if (len < 10 || len > 17) return PARSE_NI_FORMAT;
+    uint8_t sep = len - 9;                                  //position of the underscore
+    uint8_t v[4] = { 0, 0, 0, 0 };                          //ss, mm, nn, ww
+    for (uint8_t i = 0; i < len; ++i)
+    {
+        char c = ni[i];
+        if (i < sep)
+        {
+            if (c < ' ' || c > '~') return PARSE_NI_FORMAT;    //component ID, printable
+        }
+        else if (i == sep)
+        {
+            if (c != '_') return PARSE_NI_FORMAT;
+        }
+        else
+        {
+            if (c < '0' || c > '9') return PARSE_NI_FORMAT;
+            uint8_t* f = &v[(i - sep - 1) / 2];
+            *f = *f * 10 + c - '0';
+        }
+    }
+    if (v[1] == 0) return PARSE_NI_FORMAT;                  //no transmission interval
+    if (v[0] >= 60 || v[2] >= v[1]) return PARSE_NI_RANGE;
+
+    txSec = v[0];
+    txInterval = v[1];
+    txOffset = v[2];
+    txWarmup = v[3];
+    memcpy(compID, ni, sep);                                //save the component ID
+    compID[sep] = 0;
+    cacheHeader();
+    return PARSE_OK;
+}
+
+//Time sync packets. A request carries the requestor's current time (not
+//currently used) and its millis() when the request was sent (origin):
+//Bytes 0-3:     utc
+//Bytes 4-7:     origin
+//A reply carries the server's time when the reply was sent, the time the
+//request was held by the server before the reply was sent (0xFFFF for a
+//broadcast reply, which answers no particular request), and the origin from
+//the request it answers. Nodes using older versions of this library read
+//only the utc:
+//Bytes 0-3:     utc
+//Bytes 4-7:     milliseconds (low 16 bits), hold time in milliseconds (high 16 bits)
+//Bytes 8-11:    origin (unicast replies only)
+
+//ask for the current time, utc is the current time of the requestor (not currently used)
+//returns the frame ID used for the transmission.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::requestTimeSync(uint32_t utc)
+{
+    uint8_t hdrLen = header('S');                           //time sync packet
+    copyToBuffer(payload + hdrLen, utc);                    //send our current time
+    tsStamp_t ts;                                           //and the origin, echoed in the reply, as it is transmitted
+    ts.offset = hdrLen;
+    ts.reply = false;
+
+    uint8_t len = hdrLen + 8;                               //send the tx request
+    uint8_t frameID = sendPayload(destAddr, 'S', len, &ts);
+    LOG_INFO(endl << msTX << F("\tTime sync\t") << len << ' ' << frameID << endl);
+    TRACE(TR_TIME_SYNC_REQ, frameID, 'S', len);
+    return frameID;
+}
+
+//respond to the queued time sync requests.
+//utc can be a time_t value (same as uint32_t), ms is the milliseconds into
+//the current second. if ms isn't known, call immediately after second rollover.
+//each requestor is answered at its own address, or if tsBroadcast is set and
+//two or more requests are queued, all are answered with one broadcast packet.
+//returns the frame ID of the (last) transmission, or zero if no request was queued.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::sendTimeSync(uint32_t utc, uint16_t ms)
+{
+    uint32_t msRef = millis() - ms;                         //millis() at the start of second utc
+    uint8_t frameID = 0;
+    if ( tsBroadcast && (tsCount > 1 || tsOverflow) )
+    {
+        XBeeAddress64 bcast(0x00000000, 0x0000FFFF);
+        frameID = sendTimeSyncTo(bcast, utc, msRef, GSXBEE_TS_SLOTS);
+        LOG_INFO(millis() << F("\tTime sync broadcast\t") << tsCount << (tsOverflow ? F("+\n") : F("\n")));
+    }
+    else
+    {
+        for (uint8_t i = 0; i < tsCount; ++i)
+        {
+            frameID = sendTimeSyncTo(tsQueue[i].addr, utc, msRef, i);
+            LOG_INFO(millis() << F("\tTime sync\t") << tsQueue[i].compID << ' ' << frameID << endl);
+        }
+    }
+    tsCount = 0;                                            //requests were serviced, none queued
+    tsOverflow = false;
+    return frameID;
+}
+
+//returns the number of time sync requests waiting to be answered by sendTimeSync()
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::tsPending()
+{
+    return tsCount;
+}
+
+//send the current time to the given destination, in reply to the request
+//in tsQueue[slot], or as a broadcast if slot is GSXBEE_TS_SLOTS.
+//utc is the time at millis() = msRef. returns the frame ID.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::sendTimeSyncTo(XBeeAddress64 &dest, uint32_t utc, uint32_t msRef, uint8_t slot)
+{
+    uint8_t hdrLen = header('S');                           //time sync packet
+    tsStamp_t ts;                                           //the current time is filled in as it is transmitted
+    ts.offset = hdrLen;
+    ts.reply = true;
+    ts.precise = slot < GSXBEE_TS_SLOTS && tsQueue[slot].precise;
+    ts.utc = utc;
+    ts.msRef = msRef;
+    uint8_t len = hdrLen + 8;
+    if (ts.precise)
+    {
+        ts.msRX = tsQueue[slot].msRX;
+        copyToBuffer(payload + hdrLen + 8, tsQueue[slot].origin);
+        len += 4;
+    }
+    uint8_t frameID = sendPayload(dest, 'S', len, &ts);
+    TRACE(TR_TIME_SYNC, frameID, 'S', len);
+    return frameID;
+}
+
+//fill in the times in a time sync packet as it goes to the XBee, so that
+//time spent building it or finding its route doesn't add to the error.
+//a request gets the origin; a reply gets the current UTC and milliseconds,
+//and the time the request was held if it is precise.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::tsStamp(uint8_t* data, tsStamp_t &ts)
+{
+    char* p = (char*)data + ts.offset;
+    uint32_t ms = millis();
+    if (!ts.reply)
+    {
+        copyToBuffer(p + 4, ms);
+        return;
+    }
+    uint32_t elapsed = ms - ts.msRef;
+    uint32_t hold = 0xFFFF;
+    if (ts.precise)
+    {
+        hold = ms - ts.msRX;
+        if (hold > 0xFFFE) hold = 0xFFFE;
+    }
+    copyToBuffer(p, ts.utc + elapsed / 1000);               //current UTC
+    copyToBuffer(p + 4, hold << 16 | elapsed % 1000);
+}
+
+//process the time sync packet just parsed. a time server queues the request
+//(once per requestor); otherwise the user's time sync function is called.
+//a reply to our own request is corrected for the round trip delay, and is
+//ignored if the delay is more than tsMaxDelay.
+template <class SerialPort, class LogSink>
+xbeeReadStatus_t gsXBeeT<SerialPort, LogSink>::timeSyncReceived()
+{
+    uint32_t ms = millis();
+    if ( isTimeServer )                                     //queue the request
+    {
+        uint8_t i;
+        for (i = 0; i < tsCount; ++i)                       //a repeated request replaces the earlier one
+        {
+            if (tsQueue[i].addr.getMsb() == sendingAddr.getMsb() && tsQueue[i].addr.getLsb() == sendingAddr.getLsb()) break;
+        }
+        if (i >= GSXBEE_TS_SLOTS)
+        {
+            tsOverflow = true;                              //can still be answered by a broadcast
+            LOG_ERROR(ms << F("\tTime sync queue full\t") << sendingCompID << endl);
+            return RX_TIMESYNC;
+        }
+        tsSlot_t* t = &tsQueue[i];
+        if (i == tsCount) ++tsCount;
+        t->addr = sendingAddr;
+        strcpy(t->compID, sendingCompID);
+        t->precise = rxDataLen >= 8;
+        if (t->precise) t->origin = getFromBuffer(payload + 4);
+        t->msRX = ms;
+        return RX_TIMESYNC;
+    }
+
+    uint32_t utc = getFromBuffer(payload);
+    uint32_t serverMs = 0;
+    uint16_t err = TS_ERR_UNKNOWN;
+    if (rxDataLen >= 8)
+    {
+        uint32_t msHold = getFromBuffer(payload + 4);
+        serverMs = msHold & 0xFFFF;
+        uint32_t hold = msHold >> 16;
+        if (rxDataLen >= 12 && hold != 0xFFFF)              //a reply to our request
+        {
+            uint32_t rtt = ms - getFromBuffer(payload + 8);
+            uint32_t dly = rtt - hold;
+            if (hold > rtt || dly > tsMaxDelay)
+            {
+                LOG_ERROR(ms << F("\tTime sync rejected\t") << rtt << ' ' << hold << endl);
+                return RX_TIMESYNC;
+            }
+            serverMs += dly / 2;                            //assume the delay was the same both ways
+            err = dly / 2 + 1;
+        }
+    }
+    utc += serverMs / 1000;
+    if (timeSyncCallback != NULL) timeSyncCallback(utc);    //call the user's time sync functions if they gave them
+    if (preciseSyncCallback != NULL) preciseSyncCallback(utc, serverMs % 1000, err);
+    return RX_TIMESYNC;
+}
+
+//set a function to be called with the time, milliseconds and estimated error
+//when a time sync packet is received (if not a time server)
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::setSyncCallback(syncCallback_t fcn)
+{
+    preciseSyncCallback = fcn;
+}
+
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::setSyncCallback( void (*fcn)(uint32_t t) )
+{
+    timeSyncCallback = fcn;
+}
+
+//set a function to be called with the outcome of each transmission
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::setTxCallback(txCallback_t fcn)
+{
+    txCallback = fcn;
+}
+
+//returns the number of transmissions awaiting a TX status, including those
+//waiting in the send queue
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::txPending()
+{
+    uint8_t n = txInFlight;
+#if GSXBEE_SEND_SLOTS > 0
+    for (uint8_t i = 0; i < sendCount; ++i)
+    {
+        if (sendSlots[i].packetType != 0) ++n;
+    }
+#endif
+    return n;
+}
+
+//send the packet in payload to the given destination with a new frame ID.
+//it goes to the XBee now, or waits in the send queue if the XBee has no room
+//for it (see txDispatch()). stamp, if not NULL, gives the times to fill in
+//a time sync packet with. returns the frame ID.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::sendPayload(XBeeAddress64 &dest, char type, uint8_t len, tsStamp_t* stamp)
+{
+    uint8_t frameID = getNextFrameId();
+    uint8_t outSlot = outTrack(dest, type, len);
+#if GSXBEE_SEND_SLOTS > 0
+    uint8_t priority = type == 'S' ? PRI_TIMESYNC : (type == 'F' ? PRI_BULK : PRI_DATA);
+    sendSlot_t* s = txNow(priority) ? NULL : sendQueue(frameID, priority, type, len);
+    if (s != NULL)
+    {
+        s->outSlot = outSlot;
+        s->dest = dest;
+        memcpy(s->data, payload, len);
+        return frameID;
+    }
+#endif
+    txFrame(frameID, dest, type, (uint8_t*)payload, len, outSlot, stamp);
+    return frameID;
+}
+
+//send a packet to the XBee and track it until its TX status arrives. several
+//transmissions can be in flight at once; if GSXBEE_TX_SLOTS are already in
+//flight, the oldest is reported to the TX callback as TX_NO_STATUS to make room.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::txFrame(uint8_t frameID, XBeeAddress64 &dest, char type, uint8_t* data, uint8_t len, uint8_t outSlot, tsStamp_t* stamp)
+{
+    ZBTxRequest zbTX;
+    zbTX.setFrameId(frameID);
+    zbTX.setAddress64(dest);
+    uint16_t addr16 = addrFind16(dest);
+    sourceRoute(dest, addr16);
+    zbTX.setAddress16(addr16);                              //skips address discovery if known
+    if (stamp != NULL) tsStamp(data, *stamp);               //last thing before it goes
+    zbTX.setPayload(data);
+    zbTX.setPayloadLength(len);
+    writeFrame(zbTX);
+    msTX = millis();
+    STAT(++stats.txSent);
+
+    uint8_t slot = 0;
+    for (uint8_t i = 0; i < GSXBEE_TX_SLOTS; ++i)
+    {
+        if (txSlots[i].frameID == 0)
+        {
+            slot = i;
+            break;
+        }
+        if (txSlots[i].msTX - txSlots[slot].msTX > 0x7FFFFFFF) slot = i;   //track the oldest in case all are in use
+    }
+    if (txSlots[slot].frameID != 0)
+    {
+        txResult_t result;
+        result.delyStatus = TX_NO_STATUS;
+        txComplete(slot, result);
+    }
+    txSlot_t* t = &txSlots[slot];
+    t->frameID = frameID;
+    t->packetType = type;
+    t->dest = dest;
+    t->msTX = msTX;
+    t->outSlot = outSlot;
+    ++txInFlight;
+}
+
+#if GSXBEE_SEND_SLOTS > 0
+//Send queue. When txWindow frames are already outstanding at the XBee
+//(transmissions awaiting a TX status plus AT commands awaiting a response),
+//further frames wait in one of GSXBEE_SEND_SLOTS slots, so the XBee's own
+//buffers never hold more than a few frames ahead of an urgent one. read()
+//sends them as room is made, most urgent first: by priority class, then by
+//deadline. A data or bulk frame that waits past its deadline is promoted to
+//PRI_CONTROL. Time sync packets never wait, and are timestamped as they go
+//(see tsStamp()). When the queue is full, the most urgent frame in it is
+//sent regardless of txWindow to make room, so frames of a class (e.g. the
+//fragments of a message) still go in order.
+
+//milliseconds a frame of each priority class may wait before it is overdue
+static const uint16_t sendDeadlines[] PROGMEM = { 0, 250, 2000, 10000 };
+
+//returns true if a frame of the given priority can go to the XBee now
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::txNow(uint8_t priority)
+{
+    if (priority == PRI_TIMESYNC || txWindow == 0) return true;
+    return sendCount == 0 && txOutstanding() < txWindow;    //nothing waiting ahead of it, and room at the XBee
+}
+
+//returns the number of frames at the XBee awaiting a TX status or an AT response
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::txOutstanding()
+{
+    uint8_t n = txInFlight + atInFlight;
+    for (uint8_t i = 0; i < sendCount; ++i)
+    {
+        if (sendSlots[i].packetType == 0) --n;              //queued AT commands already have their slots
+    }
+    return n;
+}
+
+//add a frame to the end of the send queue, making room if it is full. the
+//caller fills in the data, and the dest and outSlot for a packet. returns
+//NULL if the frame is too long, and should be sent at once.
+template <class SerialPort, class LogSink>
+typename gsXBeeT<SerialPort, LogSink>::sendSlot_t* gsXBeeT<SerialPort, LogSink>::sendQueue(uint8_t frameID, uint8_t priority, char type, uint8_t len)
+{
+    if (len > PAYLOAD_LEN) return NULL;
+    if (sendCount >= GSXBEE_SEND_SLOTS) txSendNext();
+    sendSlot_t* s = &sendSlots[sendCount++];
+    s->frameID = frameID;
+    s->priority = priority;
+    s->packetType = type;
+    s->len = len;
+    s->outSlot = OUT_NONE;
+    s->msQueued = millis();
+    LOG_INFO(s->msQueued << F("\tXB TX WAIT\t") << priority << ' ' << frameID << endl);
+    TRACE(TR_TX_WAIT, frameID, priority, sendCount);
+    return s;
+}
+
+//remove a frame from the send queue, keeping the rest in order
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::sendRemove(uint8_t i)
+{
+    --sendCount;
+    memmove(&sendSlots[i], &sendSlots[i + 1], (sendCount - i) * sizeof(sendSlot_t));
+}
+
+//send queued frames to the XBee while it has room, most urgent first
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::txDispatch()
+{
+    while (sendCount > 0 && (txWindow == 0 || txOutstanding() < txWindow)) txSendNext();
+}
+
+//send the most urgent queued frame to the XBee: the earliest priority class,
+//then the earliest deadline. a data or bulk frame past its deadline counts
+//as PRI_CONTROL.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::txSendNext()
+{
+    uint32_t ms = millis();
+    uint8_t next = 0;
+    uint8_t nextPri = 0xFF;
+    uint32_t nextDue = 0;
+    for (uint8_t i = 0; i < sendCount; ++i)
+    {
+        sendSlot_t* s = &sendSlots[i];
+        uint8_t pri = s->priority;
+        uint32_t due = s->msQueued + pgm_read_word(&sendDeadlines[pri]);
+        if (pri > PRI_CONTROL && ms - due < 0x80000000) pri = PRI_CONTROL;     //overdue
+        if (pri < nextPri || (pri == nextPri && due - nextDue > 0x7FFFFFFF))   //earlier class, or same class and due sooner
+        {
+            next = i;
+            nextPri = pri;
+            nextDue = due;
+        }
+    }
+    sendSlot_t* s = &sendSlots[next];
+    LOG_INFO(ms << F("\tXB TX SEND\t") << ms - s->msQueued << F("ms ") << s->frameID << endl);
+    if (s->packetType == 0)
+        atFrame(s->frameID, s->data, s->data + 2, s->len - 2);
+    else
+        txFrame(s->frameID, s->dest, s->packetType, s->data, s->len, s->outSlot);
+    sendRemove(next);                                       //anything queued meanwhile was added after it
+}
+#endif
+
+//process a TX status frame, match it to the transmission it reports on
+template <class SerialPort, class LogSink>
+xbeeReadStatus_t gsXBeeT<SerialPort, LogSink>::txStatusResponse(uint32_t ms)
+{
+    ZBTxStatusResponse zbStat;
+    getResponse().getZBTxStatusResponse(zbStat);
+    txResult_t result;
+    result.delyStatus = zbStat.getDeliveryStatus();
+    result.dscyStatus = zbStat.getDiscoveryStatus();
+    result.retries = zbStat.getTxRetryCount();
+    result.addr16 = zbStat.getRemoteAddress();
+    uint8_t frameID = zbStat.getFrameId();
+    uint32_t msSent = msTX;
+    uint8_t slot = GSXBEE_TX_SLOTS;
+    for (uint8_t i = 0; i < GSXBEE_TX_SLOTS; ++i)
+    {
+        if (txSlots[i].frameID != 0 && txSlots[i].frameID == frameID)
+        {
+            slot = i;
+            msSent = txSlots[i].msTX;
+            break;
+        }
+    }
+    (void)ms;                                               //only logged and traced
+    (void)msSent;
+    switch (result.delyStatus)
+    {
+    case SUCCESS:
+        LOG_INFO(ms << F("\tXB TX OK\t") << ms - msSent << F("ms R="));
+        LOG_INFO(result.retries << F(" DSCY=") << result.dscyStatus << ' ' << frameID << endl);
+        TRACE(TR_TX_OK, frameID, result.retries, ms - msSent);
+        break;
+    default:
+        LOG_ERROR(ms << F("\tXB TX FAIL\t") << ms - msSent << F("ms R="));
+        LOG_ERROR(result.retries << F(" DELY=") << result.delyStatus << F(" DSCY=") << result.dscyStatus << ' ' << frameID << endl);
+        TRACE(TR_TX_FAIL, frameID, result.delyStatus, ms - msSent);
+        break;
+    }
+    if (slot < GSXBEE_TX_SLOTS) txComplete(slot, result);
+    return result.delyStatus == SUCCESS ? TX_ACK : TX_FAIL;
+}
+
+//release a TX slot and report the outcome of its transmission to the TX callback.
+//the caller supplies the status fields of result; no status fields are needed for TX_NO_STATUS.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::txComplete(uint8_t slot, txResult_t &result)
+{
+    txSlot_t* t = &txSlots[slot];
+    result.frameID = t->frameID;
+    result.packetType = t->packetType;
+    result.dest = t->dest;
+    result.latency = millis() - t->msTX;
+    if (result.delyStatus == TX_NO_STATUS)
+    {
+        result.dscyStatus = 0;
+        result.retries = 0;
+        result.addr16 = 0xFFFE;
+    }
+    t->frameID = 0;
+    --txInFlight;
+    if (t->outSlot != OUT_NONE) outResult(t->outSlot, result.delyStatus == SUCCESS);
+    if (result.delyStatus == SUCCESS)
+        addrUpdate16(result.dest, result.addr16);
+    else
+    {
+        addrUpdate16(result.dest, 0xFFFE);                  //the node may have a new address, rediscover it
+        routeForget(result.dest);                           //and the route may be broken
+    }
+    STAT(statsTx(result));
+    if (txCallback != NULL) txCallback(result);
+}
+
+//Outbound queue. Data packets (types D, B, H and M) are kept in one of
+//GSXBEE_OUT_SLOTS slots until they are delivered. A packet that fails is
+//retransmitted after a backoff that doubles with each try, up to retryLimit
+//transmissions in all. A packet that runs out of tries, or is pushed out of
+//its slot by a newer packet, is written to the backlog store (if one is set,
+//see setStore()) and retransmitted later with a fresh set of tries; without
+//a store it is dropped. Retransmissions are paced at outPace milliseconds
+//(plus jitter) and are held while the XBee is disassociated.
+
+//keep a copy of the packet being sent from payload in the outbound queue.
+//returns the slot, or OUT_NONE if the packet is not kept.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::outTrack(XBeeAddress64 &dest, char type, uint8_t len)
+{
+#if GSXBEE_OUT_SLOTS > 0
+    if (outSending != OUT_NONE) return outSending;          //a retransmission, already queued
+    if (retryLimit <= 1 || (type != 'D' && type != 'B' && type != 'H' && type != 'M')) return OUT_NONE;
+    uint8_t slot = OUT_NONE;
+    for (uint8_t i = 0; i < GSXBEE_OUT_SLOTS; ++i)
+    {
+        outSlot_t* o = &outSlots[i];
+        if (o->state == OUT_FREE)
+        {
+            slot = i;
+            break;
+        }
+        if (o->state == OUT_WAITING && (slot == OUT_NONE || o->retryAt - outSlots[slot].retryAt > 0x7FFFFFFF))
+            slot = i;                                       //the waiting packet due first, in case none are free
+    }
+    if (slot == OUT_NONE) return OUT_NONE;                  //all in flight
+    if (outSlots[slot].state == OUT_WAITING) outStore(slot);
+    outSlot_t* o = &outSlots[slot];
+    o->state = OUT_IN_FLIGHT;
+    o->tries = 1;
+    o->packetType = type;
+    o->len = len;
+    o->dest = dest;
+    memcpy(o->data, payload, len);
+    ++outCount;
+    return slot;
+#else
+    (void)dest;
+    (void)type;
+    (void)len;
+    return OUT_NONE;
+#endif
+}
+
+//the transmission of the packet in an outbound queue slot has completed.
+//free the slot if it was delivered, else schedule a retransmission or give up.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::outResult(uint8_t slot, bool delivered)
+{
+#if GSXBEE_OUT_SLOTS > 0
+    const uint16_t RETRY_MIN(2000);                         //milliseconds before the first retransmission, doubles up to
+    const uint16_t RETRY_MAX(32000);                        //this limit
+    outSlot_t* o = &outSlots[slot];
+    if (delivered)
+    {
+        o->state = OUT_FREE;
+        --outCount;
+    }
+    else if (o->tries < retryLimit)
+    {
+        uint16_t backoff = RETRY_MIN << (o->tries < 5 ? o->tries - 1 : 4);
+        if (backoff > RETRY_MAX) backoff = RETRY_MAX;
+        o->state = OUT_WAITING;
+        o->retryAt = millis() + backoff + jitter(backoff / 2);
+    }
+    else
+    {
+        outStore(slot);
+    }
+#else
+    (void)slot;
+    (void)delivered;
+#endif
+}
+
+#if GSXBEE_OUT_SLOTS > 0
+//retransmit a waiting packet whose time has come, or load one from the
+//backlog store into a free slot and retransmit it. at most one per outPace
+//milliseconds, and none while the XBee is disassociated.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::outService(uint32_t ms)
+{
+    if (linkStatus == LINK_DOWN || ms - outLastSend < outWait) return;
+    uint8_t slot = OUT_NONE;
+    for (uint8_t i = 0; i < GSXBEE_OUT_SLOTS; ++i)
+    {
+        outSlot_t* o = &outSlots[i];
+        if (o->state == OUT_WAITING && ms - o->retryAt < 0x80000000) slot = i;
+        if (slot == OUT_NONE && o->state == OUT_FREE && storeCount && outLoad(i)) slot = i;
+        if (slot != OUT_NONE) break;
+    }
+    if (slot == OUT_NONE) return;
+
+    outSlot_t* o = &outSlots[slot];
+    o->state = OUT_IN_FLIGHT;
+    ++o->tries;
+    memcpy(payload, o->data, o->len);
+    LOG_INFO(ms << F("\tXB RETRY\t") << o->packetType << ' ' << o->tries << endl);
+    TRACE(TR_OUT_RETRY, slot, o->tries, storeCount);
+    STAT(++stats.outRetries);
+    outSending = slot;
+    sendPayload(o->dest, o->packetType, o->len);
+    outSending = OUT_NONE;
+    outLastSend = ms;
+    outWait = outPace + jitter(outPace / 2 + 1);
+}
+
+//move the packet in an outbound queue slot to the backlog store and free the
+//slot. if the store is full, the oldest records are dropped to make room.
+//without a store, the packet is dropped.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::outStore(uint8_t slot)
+{
+    outSlot_t* o = &outSlots[slot];
+    o->state = OUT_FREE;
+    --outCount;
+    uint16_t cap = store == NULL ? 0 : store->size() - STORE_HEADER;
+    uint16_t need = STORE_RECORD + o->len;
+    if (need > cap)
+    {
+        LOG_ERROR(millis() << F("\tXB OUT DROP\t") << o->packetType << endl);
+        TRACE(TR_OUT_DROP, o->packetType, o->len);
+        STAT(++stats.outDropped);
+        return;
+    }
+    for (;;)                                                //drop the oldest records until there's room
+    {
+        uint16_t used = (storeHead + cap - storeTail) % cap;
+        if (storeCount == 0 || (used != 0 && cap - used >= need)) break;
+        uint8_t len;
+        storeIO(storeTail, &len, 1, false);
+        storeTail = (storeTail + STORE_RECORD + len) % cap;
+        --storeCount;
+        LOG_ERROR(millis() << F("\tXB OUT DROP\tstored\n"));
+        TRACE(TR_OUT_DROP, 0, len);
+        STAT(++stats.outDropped);
+    }
+    uint8_t rec[STORE_RECORD];
+    rec[0] = o->len;
+    rec[1] = o->packetType;
+    copyToBuffer((char*)rec + 2, o->dest.getMsb());
+    copyToBuffer((char*)rec + 6, o->dest.getLsb());
+    storeIO(storeHead, rec, STORE_RECORD, true);
+    storeIO((storeHead + STORE_RECORD) % cap, (uint8_t*)o->data, o->len, true);
+    storeHead = (storeHead + need) % cap;
+    ++storeCount;
+    storeHeader(true);
+    LOG_INFO(millis() << F("\tXB OUT STORE\t") << o->packetType << ' ' << storeCount << endl);
+    TRACE(TR_OUT_STORE, o->packetType, o->len, storeCount);
+    STAT(++stats.outStored);
+}
+
+//load the oldest record from the backlog store into a free outbound queue slot,
+//with a fresh set of tries. returns false if there was none.
+template <class SerialPort, class LogSink>
+bool gsXBeeT<SerialPort, LogSink>::outLoad(uint8_t slot)
+{
+    if (store == NULL || storeCount == 0) return false;
+    uint16_t cap = store->size() - STORE_HEADER;
+    uint8_t rec[STORE_RECORD];
+    storeIO(storeTail, rec, STORE_RECORD, false);
+    outSlot_t* o = &outSlots[slot];
+    o->len = rec[0] <= PAYLOAD_LEN ? rec[0] : PAYLOAD_LEN;
+    o->packetType = rec[1];
+    o->dest = XBeeAddress64(getFromBuffer((char*)rec + 2), getFromBuffer((char*)rec + 6));
+    storeIO((storeTail + STORE_RECORD) % cap, (uint8_t*)o->data, o->len, false);
+    storeTail = (storeTail + STORE_RECORD + rec[0]) % cap;
+    --storeCount;
+    storeHeader(true);
+    o->state = OUT_WAITING;
+    o->tries = 0;
+    o->retryAt = millis();
+    ++outCount;
+    return true;
+}
+
+//read or write the store's data area, wrapping around its end
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::storeIO(uint16_t pos, uint8_t* buf, uint8_t len, bool write)
+{
+    uint16_t cap = store->size() - STORE_HEADER;
+    uint8_t n = cap - pos < len ? cap - pos : len;          //bytes before the end
+    if (write)
+    {
+        store->write(STORE_HEADER + pos, buf, n);
+        if (n < len) store->write(STORE_HEADER, buf + n, len - n);
+    }
+    else
+    {
+        store->read(STORE_HEADER + pos, buf, n);
+        if (n < len) store->read(STORE_HEADER, buf + n, len - n);
+    }
+}
+
+//read or write the store's position, which makes the backlog survive an MCU reset.
+//rather than rewriting one header each time a record is stored or loaded, the
+//position is written to the next of STORE_POS_SLOTS records in turn, which
+//spreads the wear, and the one with the latest sequence number is read back:
+//Byte  0:       checksum, STORE_MAGIC plus bytes 1-7 plus the store size / 256
+//Byte  1:       sequence number, which also gives the record's slot
+//Bytes 2-3:     storeHead
+//Bytes 4-5:     storeTail
+//Bytes 6-7:     storeCount
+//when read, a store with no valid position record is emptied.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::storeHeader(bool write)
+{
+    uint16_t cap = store->size() - STORE_HEADER;
+    uint8_t h[STORE_POS];
+    if (write)
+    {
+        h[1] = ++storeSeq;
+        h[2] = storeHead >> 8;
+        h[3] = storeHead;
+        h[4] = storeTail >> 8;
+        h[5] = storeTail;
+        h[6] = storeCount >> 8;
+        h[7] = storeCount;
+        h[0] = storeCheck(h);
+        store->write(storeSeq % STORE_POS_SLOTS * STORE_POS, h, STORE_POS);
+        return;
+    }
+    bool found = false;
+    for (uint8_t i = 0; i < STORE_POS_SLOTS; ++i)
+    {
+        store->read(i * STORE_POS, h, STORE_POS);
+        uint16_t head = h[2] << 8 | h[3];
+        uint16_t tail = h[4] << 8 | h[5];
+        uint16_t count = h[6] << 8 | h[7];
+        if (h[0] != storeCheck(h) || h[1] % STORE_POS_SLOTS != i || head >= cap || tail >= cap
+            || (count == 0 && head != tail)) continue;
+        if (found && (int8_t)(h[1] - storeSeq) < 0) continue;    //an older one
+        found = true;
+        storeSeq = h[1];
+        storeHead = head;
+        storeTail = tail;
+        storeCount = count;
+    }
+    if (!found)
+    {
+        storeHead = storeTail = storeCount = 0;
+        storeHeader(true);
+    }
+}
+
+//returns the checksum of a backlog store position record
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::storeCheck(uint8_t* h)
+{
+    uint8_t sum = STORE_MAGIC + (store->size() >> 8);
+    for (uint8_t i = 1; i < STORE_POS; ++i) sum += h[i];
+    return sum;
+}
+#endif
+
+//set the store for the outbound queue's backlog, e.g. a gsXBeeEEPROM, or NULL
+//for none. records already in the store (from before an MCU reset) are kept
+//and sent. the store must hold its 64-byte position records plus one record
+//of the largest payload, i.e. at least 158 bytes; a smaller one isn't used.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::setStore(gsXBeeStore* s)
+{
+#if GSXBEE_OUT_SLOTS > 0
+    store = s;
+    storeCount = 0;
+    if (store == NULL) return;
+    if (store->size() < STORE_HEADER + STORE_RECORD + PAYLOAD_LEN)
+    {
+        LOG_ERROR(millis() << F("\tXB STORE TOO SMALL\t") << store->size() << endl);
+        store = NULL;
+        return;
+    }
+    storeHeader(false);
+#else
+    (void)s;
+#endif
+}
+
+//returns the number of data packets in the outbound queue and backlog store
+//that have not yet been delivered.
+template <class SerialPort, class LogSink>
+uint16_t gsXBeeT<SerialPort, LogSink>::outPending()
+{
+#if GSXBEE_OUT_SLOTS > 0
+    return outCount + storeCount;
+#else
+    return 0;
+#endif
+}
+
+//give up on transmissions whose TX status has not arrived
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::txExpire(uint32_t ms)
+{
+    for (uint8_t i = 0; i < GSXBEE_TX_SLOTS; ++i)
+    {
+        if (txSlots[i].frameID != 0 && ms - txSlots[i].msTX >= TX_STATUS_TIMEOUT)
+        {
+            LOG_ERROR(ms << F("\tXB TX NO STATUS\t") << txSlots[i].frameID << endl);
+            TRACE(TR_TX_NO_STATUS, txSlots[i].frameID);
+            txResult_t result;
+            result.delyStatus = TX_NO_STATUS;
+            txComplete(i, result);
+        }
+    }
+}
+
+//copy the link statistics. all zero if GSXBEE_STATS is 0.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::getStats(xbeeStats_t &s)
+{
+#if GSXBEE_STATS
+    s = stats;
+#else
+    memset(&s, 0, sizeof(s));
+#endif
+}
+
+//zero the link statistics
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::resetStats()
+{
+#if GSXBEE_STATS
+    memset(&stats, 0, sizeof(stats));
+    stats.msSince = millis();
+#endif
+}
+
+#if GSXBEE_STATS
+//count the outcome of a transmission
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::statsTx(txResult_t &result)
+{
+    if (result.delyStatus == SUCCESS)
+    {
+        ++stats.txAck;
+    }
+    else
+    {
+        uint8_t f;
+        switch (result.delyStatus)
+        {
+            case CCA_FAILURE:           f = 0; break;
+            case NETWORK_ACK_FAILURE:   f = 1; break;
+            case NOT_JOINED_TO_NETWORK: f = 2; break;
+            case ADDRESS_NOT_FOUND:     f = 3; break;
+            case ROUTE_NOT_FOUND:       f = 4; break;
+            case PAYLOAD_TOO_LARGE:     f = 5; break;
+            case TX_NO_STATUS:          f = 6; break;
+            default:                    f = 7; break;
+        }
+        ++stats.txFail[f];
+        if (result.delyStatus == TX_NO_STATUS) return;      //no retries, discovery or latency to count
+    }
+    ++stats.txRetries[result.retries < STATS_RETRIES ? result.retries : STATS_RETRIES - 1];
+    ++stats.txDscy[result.dscyStatus < STATS_DSCY - 1 ? result.dscyStatus : STATS_DSCY - 1];
+    uint8_t i = 0;
+    for (uint16_t l = result.latency >> 5; l != 0 && i < STATS_LATENCY - 1; l >>= 1) ++i;  //power of two buckets from 32ms
+    ++stats.txLatency[i];
+    stats.txLatencySum += result.latency;
+}
+
+//count a received signal strength value
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::statsRSS(int8_t dBm)
+{
+    uint8_t d = -dBm;
+    uint8_t i = d < 50 ? 0 : (d - 40) / 10;                 //10dB buckets from -50dBm
+    ++stats.rss[i < STATS_RSS ? i : STATS_RSS - 1];
+    stats.rssSum += dBm;
+}
+#endif
+
+//send a summary of the link statistics to the destination as an H packet.
+//the data is in GroveStreams' format, so the coordinator can forward it
+//like a D packet: &ts=sent&ta=delivered&tf=not delivered&tl=mean TX latency ms
+//&rs=mean RSS dBm&re=receive errors&ro=receive overruns&dc=disassociations
+//if that is too long for one packet (it never is fragmented, as coordinators
+//may not reassemble messages), it is split across two H packets.
+//returns the frame ID (of the last packet), or zero if GSXBEE_STATS is 0.
+template <class SerialPort, class LogSink>
+uint8_t gsXBeeT<SerialPort, LogSink>::sendStats()
+{
+#if GSXBEE_STATS
+    uint16_t txFail = 0, nLatency = 0, nRSS = 0;
+    for (uint8_t i = 0; i < STATS_TX_FAIL; ++i) txFail += stats.txFail[i];
+    for (uint8_t i = 0; i < STATS_LATENCY; ++i) nLatency += stats.txLatency[i];
+    for (uint8_t i = 0; i < STATS_RSS; ++i) nRSS += stats.rss[i];
+    int32_t v[] =
+    {
+        stats.txSent, stats.txAck, txFail,
+        nLatency ? (int32_t)(stats.txLatencySum / nLatency) : 0,
+        nRSS ? stats.rssSum / nRSS : 0,
+        stats.readStatus[RX_ERROR] + stats.readStatus[RX_UNKNOWN], stats.rxOverruns, stats.mdmDisassoc
+    };
+    const char keys[] = "tstatftlrsrerodc";                 //two characters each, in the order of v
+    uint8_t maxLen = PAYLOAD_LEN - 4 - strlen(compID);      //SOH, packet type, component ID, STX, zero terminator
+    char data[PAYLOAD_LEN];
+    char item[16];                                          //&, key, =, value
+    uint8_t len = 0;
+    uint8_t frameID = 0;
+    for (uint8_t i = 0; i < sizeof(v) / sizeof(v[0]); ++i)
+    {
+        item[0] = '&';
+        item[1] = keys[2 * i];
+        item[2] = keys[2 * i + 1];
+        item[3] = '=';
+        ltoa(v[i], item + 4, 10);
+        uint8_t itemLen = strlen(item);
+        if (len + itemLen > maxLen)                         //send what fits as one H packet, the rest in another
+        {
+            frameID = sendData(data, 'H');
+            len = 0;
+        }
+        memcpy(data + len, item, itemLen + 1);
+        len += itemLen;
+    }
+    return len ? sendData(data, 'H') : frameID;
+#else
+    return 0;
+#endif
+}
+
+//reset the mcu
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::mcuReset(uint32_t dly)
+{
+    if ( dly > 4000 ) delay(dly - 4000);
+    LOG_ERROR(millis() << F("\tReset in"));
+    TRACE(TR_RESET);
+    wdt_enable(WDTO_4S);
+    int countdown = 4;
+    while (1)
+    {
+        LOG_ERROR(' ' << countdown);
+        --countdown;
+        delay(1000);
+    }
+}
+
+#ifdef GSXBEE_TRACE
+//trace event names, in xbeeTraceEvent_t order
+static const char traceNames[] PROGMEM =
+    "NO RESPONSE\0" "ASSOC FAIL\0" "VR FAIL\0" "HW RST\0" "ASC\0" "DISASC\0" "MDM STAT\0"
+    "RX/ACK\0" "RX\0" "RX NO ACK\0" "RX UNK TYPE\0" "RX MALFORMED\0" "RX QUEUE FULL\0" "UNEXP TYPE\0"
+    "CMD\0" "CMD FAIL\0" "UNK CMD RESP\0" "CMD TIMEOUT\0" "RSS LEN ERR\0"
+    "TX\0" "TX OK\0" "TX FAIL\0" "TX NO STATUS\0" "TIME SYNC REQ\0" "TIME SYNC\0" "RESET\0"
+    "MSG\0" "MSG DROPPED\0" "ROUTE RECORD\0" "SOURCE ROUTE\0" "REASC\0"
+    "OUT RETRY\0" "OUT STORE\0" "OUT DROP\0" "TX WAIT\0";
+
+//record a trace event in the ring buffer, overwriting the oldest record if it's full
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::trace(uint8_t event, uint8_t a, uint8_t b, uint16_t c)
+{
+    xbeeTrace_t* t = &traceBuf[traceHead];
+    t->ms = millis();
+    t->event = event;
+    t->a = a;
+    t->b = b;
+    t->c = c;
+    if (++traceHead >= GSXBEE_TRACE_LEN) traceHead = 0;
+    if (traceCount < GSXBEE_TRACE_LEN) ++traceCount;
+}
+#endif
+
+//print the trace records, oldest first, then empty the trace buffer.
+//each line has the time, event name, and three event-specific values:
+//  RX: packet type, data length; CMD, CMD FAIL, CMD TIMEOUT: command chars, frame ID or status;
+//  TX, TIME SYNC: frame ID, packet type, length; TX OK: frame ID, retries, latency;
+//  TX FAIL: frame ID, delivery status, latency; MDM STAT, UNEXP TYPE: status or API ID;
+//  MSG: message ID, packet type, length; MSG DROPPED: message ID, fragment sequence number;
+//  ROUTE RECORD, SOURCE ROUTE: number of hops, 0, 16-bit address;
+//  REASC: 0, 0, seconds disassociated; OUT RETRY: slot, tries, records stored;
+//  OUT STORE: packet type, length, records stored; OUT DROP: packet type (0 if stored), length;
+//  TX WAIT: frame ID, priority, frames queued.
+//does nothing unless GSXBEE_TRACE is defined.
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::traceDump(Print &out)
+{
+#ifdef GSXBEE_TRACE
+    uint8_t i = traceHead + GSXBEE_TRACE_LEN - traceCount;
+    if (i >= GSXBEE_TRACE_LEN) i -= GSXBEE_TRACE_LEN;
+    for (; traceCount > 0; --traceCount)
+    {
+        xbeeTrace_t* t = &traceBuf[i];
+        const char* name = traceNames;
+        for (uint8_t e = t->event; e > 0; --e) name += strlen_P(name) + 1;
+        out << t->ms << '\t' << (const __FlashStringHelper*)name << '\t';
+        out << t->a << ' ' << t->b << ' ' << t->c << endl;
+        if (++i >= GSXBEE_TRACE_LEN) i = 0;
+    }
+#else
+    (void)out;
+#endif
+}
+
+//copy a four-byte integer to the designated offset in the buffer
+template <class SerialPort, class LogSink>
+void gsXBeeT<SerialPort, LogSink>::copyToBuffer(char* dest, uint32_t source)
+{
+    charInt_t data;
+
+    data.i = source;
+    dest[0] = data.c[0];
+    dest[1] = data.c[1];
+    dest[2] = data.c[2];
+    dest[3] = data.c[3];
+}
+
+//get a four-byte integer from the buffer starting at the designated offset
+template <class SerialPort, class LogSink>
+uint32_t gsXBeeT<SerialPort, LogSink>::getFromBuffer(char* source)
+{
+    charInt_t data;
+
+    data.c[0] = source[0];
+    data.c[1] = source[1];
+    data.c[2] = source[2];
+    data.c[3] = source[3];
+
+    return data.i;
+}
+
+template <class XBeeType>
+gsXBeeWriterT<XBeeType>::gsXBeeWriterT(XBeeType &xbee, char packetType)
+    : _xbee(xbee), _len(0), _overflow(false)
+{
+    _buf = _xbee.beginPacket(packetType);
+    _room = _xbee.packetRoom();
+}
+
+template <class XBeeType>
+size_t gsXBeeWriterT<XBeeType>::write(uint8_t c)
+{
+    if (_len >= _room)
+    {
+        _overflow = true;
+        return 0;
+    }
+    _buf[_len++] = c;
+    return 1;
+}
+
+template <class XBeeType>
+size_t gsXBeeWriterT<XBeeType>::write(const uint8_t* buf, size_t n)
+{
+    if (n > (size_t)(_room - _len))
+    {
+        n = _room - _len;
+        _overflow = true;
+    }
+    memcpy(_buf + _len, buf, n);
+    _len += n;
+    return n;
+}
+
+//send the packet. returns the frame ID, or zero if it overflowed, in which
+//case nothing is sent.
+template <class XBeeType>
+uint8_t gsXBeeWriterT<XBeeType>::send()
+{
+    return _xbee.endPacket(_overflow ? 0xFF : _len);
+}
+
+#undef LOG_ERROR
+#undef LOG_INFO
+#undef TRACE
+#undef STAT
+#endif
@@ -0,0 +1,224 @@
+// Arduino XBee Library for GroveStreams Wireless Sensor Network.
+//
+// This work by Jack Christensen is licensed under CC BY-SA 4.0,
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// gsXBeeSim is a Stream that stands in for an XBee radio in API mode 2.
+// API frames (TX status, AT command responses, modem status, ZB RX) are
+// scripted into a caller-supplied buffer, then read back by gsXBee::read()
+// exactly as if they had arrived from the radio. Bytes that gsXBee writes
+// to the "radio" are counted and discarded. Useful for benchmarks and for
+// exercising the library without an XBee attached. gsXBeeSimStore, below,
+// stands in for the EEPROM of a backlog store.
+//
+// Example:
+//   uint8_t simBuf[256];
+//   gsXBeeSim sim(simBuf, sizeof(simBuf));
+//   gsXBee xb;
+//   xb.setSerial(sim);
+//   sim.modemStatus(ASSOCIATED);
+//   sim.packet(XBeeAddress64(0x0013A200, 0x40A1B2C3), 'D', "node1", "&t=21.5");
+//   xb.read();      //returns MODEM_STATUS
+//   xb.read();      //returns RX_DATA
+
+#ifndef _GSXBEESIM_H
+#define _GSXBEESIM_H
+#include <gsXBee.h>
+
+class gsXBeeSim : public Stream
+{
+public:
+    gsXBeeSim(uint8_t* buf, uint16_t bufSize)
+        : bytesRead(0), bytesWritten(0), buf(buf), bufSize(bufSize), len(0), pos(0), loop(false) {}
+
+    //script an API frame. frame data excludes the API identifier.
+    //returns false (and scripts nothing) if the buffer is full.
+    bool frame(uint8_t apiID, uint8_t* data, uint8_t dataLen)
+    {
+        uint16_t start = len;
+        uint8_t sum = apiID;
+        bool ok = put(START_BYTE, false) && put(0, true) && put(dataLen + 1, true) && put(apiID, true);
+        for (uint8_t i = 0; ok && i < dataLen; ++i)
+        {
+            ok = put(data[i], true);
+            sum += data[i];
+        }
+        if ( ok && put(0xFF - sum, true) ) return true;
+        len = start;                                        //didn't fit, back it out
+        return false;
+    }
+
+    //transmit status (0x8B) for a packet we sent
+    bool txStatus(uint8_t frameID, uint8_t delyStatus, uint8_t dscyStatus = 0, uint8_t retries = 0, uint16_t addr16 = 0xFFFD)
+    {
+        uint8_t d[] = { frameID, (uint8_t)(addr16 >> 8), (uint8_t)addr16, retries, delyStatus, dscyStatus };
+        return frame(ZB_TX_STATUS_RESPONSE, d, sizeof(d));
+    }
+
+    //response (0x88) to a local AT command
+    bool atResponse(uint8_t frameID, const char* cmd, uint8_t status, const uint8_t* value = NULL, uint8_t valueLen = 0)
+    {
+        uint8_t d[4 + MAX_VALUE];
+        if (valueLen > MAX_VALUE) return false;
+        d[0] = frameID;
+        d[1] = cmd[0];
+        d[2] = cmd[1];
+        d[3] = status;
+        for (uint8_t i = 0; i < valueLen; ++i) d[4 + i] = value[i];
+        return frame(AT_COMMAND_RESPONSE, d, 4 + valueLen);
+    }
+
+    //AT command response with a string value, e.g. for NI
+    bool atString(uint8_t frameID, const char* cmd, const char* value)
+    {
+        return atResponse(frameID, cmd, AT_OK, (const uint8_t*)value, strlen(value));
+    }
+
+    //modem status (0x8A)
+    bool modemStatus(uint8_t status)
+    {
+        return frame(MODEM_STATUS_RESPONSE, &status, 1);
+    }
+
+    //ZB receive packet (0x90) carrying arbitrary RF data
+    bool zbRX(XBeeAddress64 addr64, uint16_t addr16, uint8_t options, const uint8_t* data, uint8_t dataLen)
+    {
+        uint8_t d[11 + MAX_FRAME_DATA_SIZE];
+        if (dataLen > MAX_FRAME_DATA_SIZE - 11) return false;
+        uint8_t* p = d;
+        p = putAddr(p, addr64.getMsb());
+        p = putAddr(p, addr64.getLsb());
+        *p++ = addr16 >> 8;
+        *p++ = addr16;
+        *p++ = options;
+        for (uint8_t i = 0; i < dataLen; ++i) *p++ = data[i];
+        return frame(ZB_RX_RESPONSE, d, p - d);
+    }
+
+    //ZB receive packet carrying a gsXBee packet: SOH, type, component ID, STX, body
+    bool packet(XBeeAddress64 addr64, char packetType, const char* compID, const uint8_t* body, uint8_t bodyLen,
+        uint8_t options = ZB_PACKET_ACKNOWLEDGED, uint16_t addr16 = 0x1234)
+    {
+        uint8_t d[PAYLOAD_LEN];
+        uint8_t n = 0;
+        d[n++] = SOH;
+        d[n++] = packetType;
+        while (*compID && n < PAYLOAD_LEN) d[n++] = *compID++;
+        if (n >= PAYLOAD_LEN) return false;
+        d[n++] = STX;
+        if (bodyLen > PAYLOAD_LEN - n) return false;
+        for (uint8_t i = 0; i < bodyLen; ++i) d[n++] = body[i];
+        return zbRX(addr64, addr16, options, d, n);
+    }
+
+    //gsXBee packet with a text body, e.g. GroveStreams data
+    bool packet(XBeeAddress64 addr64, char packetType, const char* compID, const char* body,
+        uint8_t options = ZB_PACKET_ACKNOWLEDGED, uint16_t addr16 = 0x1234)
+    {
+        return packet(addr64, packetType, compID, (const uint8_t*)body, strlen(body), options, addr16);
+    }
+
+    //script a run of raw bytes, e.g. noise or a truncated frame
+    bool raw(const uint8_t* data, uint16_t dataLen)
+    {
+        if (dataLen > bufSize - len) return false;
+        for (uint16_t i = 0; i < dataLen; ++i) buf[len++] = data[i];
+        return true;
+    }
+
+    void rewind() { pos = 0; }                              //play the script again from the start
+    void clear() { len = pos = 0; }                         //discard the script
+    void repeat(bool r) { loop = r; }                       //replay the script continuously
+    uint16_t scriptLength() { return len; }
+
+    //Stream interface
+    int available()
+    {
+        if (pos >= len && loop) pos = 0;
+        return len - pos;
+    }
+    int read()
+    {
+        if ( !available() ) return -1;
+        ++bytesRead;
+        return buf[pos++];
+    }
+    int peek()
+    {
+        return available() ? buf[pos] : -1;
+    }
+    size_t write(uint8_t)
+    {
+        ++bytesWritten;
+        return 1;
+    }
+    void flush() {}
+    using Print::write;
+
+    uint32_t bytesRead;                                     //bytes read from the simulated radio
+    uint32_t bytesWritten;                                  //bytes sent to the simulated radio
+
+private:
+    static const uint8_t MAX_VALUE = 32;                    //longest AT command value that can be scripted
+
+    //append a byte, escaping it if needed (API mode 2)
+    bool put(uint8_t b, bool escape)
+    {
+        bool esc = escape && (b == START_BYTE || b == ESCAPE || b == XON || b == XOFF);
+        if (len + esc + 1 > bufSize) return false;
+        if (esc)
+        {
+            buf[len++] = ESCAPE;
+            b ^= 0x20;
+        }
+        buf[len++] = b;
+        return true;
+    }
+
+    static uint8_t* putAddr(uint8_t* p, uint32_t a)
+    {
+        *p++ = a >> 24;
+        *p++ = a >> 16;
+        *p++ = a >> 8;
+        *p++ = a;
+        return p;
+    }
+
+    uint8_t* buf;
+    uint16_t bufSize;
+    uint16_t len;
+    uint16_t pos;
+    bool loop;
+};
+
+//gsXBeeSimStore stands in for non-volatile memory (see gsXBeeEEPROM.h) as
+//the outbound queue's backlog store, in a caller-supplied buffer. Counts the
+//bytes written, for estimating EEPROM wear.
+class gsXBeeSimStore : public gsXBeeStore
+{
+public:
+    gsXBeeSimStore(uint8_t* buf, uint16_t bufSize) : bytesWritten(0), buf(buf), bufSize(bufSize)
+    {
+        memset(buf, 0xFF, bufSize);                         //like erased EEPROM
+    }
+
+    uint16_t size() { return bufSize; }
+
+    void read(uint16_t addr, uint8_t* b, uint8_t n)
+    {
+        memcpy(b, buf + addr, n);
+    }
+
+    void write(uint16_t addr, const uint8_t* b, uint8_t n)
+    {
+        memcpy(buf + addr, b, n);
+        bytesWritten += n;
+    }
+
+    uint32_t bytesWritten;                                  //bytes written to the store
+
+private:
+    uint8_t* buf;
+    uint16_t bufSize;
+};
+#endif